@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+/*
+ * Compares the atomic operations with the increment under the mutex.
+ *
+ * Each thread increments a shared counter by PMAtomic::fetch_add,
+ * by the PMAtomic::compare_exchange loop, which is the usual way of
+ * the lock-free updates, and under PMFastMutex. The test is run by
+ * one thread, which shows the cost of the uncontended operations,
+ * and by several threads at the same time.
+ *
+ * Usage: atombench [threads [iterations]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pm_os2.h"
+#include "pm_atomic.h"
+#include "pm_fastmutex.h"
+#include "pm_lock.h"
+#include "bench.h"
+
+static ULONG iterations = 1000000;
+
+static PMAtomic<ULONG> atomic;
+static PMFastMutex     mutex;
+static volatile ULONG  counter;
+
+/* Increments the counter by fetch_add.
+ */
+
+static void add( ULONG, void* )
+{
+  ULONG i;
+
+  for( i = 0; i < iterations; i++ ) {
+    atomic.fetch_add( 1 );
+  }
+}
+
+/* Increments the counter by the compare and exchange loop.
+ */
+
+static void cas( ULONG, void* )
+{
+  ULONG value;
+  ULONG i;
+
+  for( i = 0; i < iterations; i++ ) {
+    value = atomic.load( PM_RELAXED );
+    while( !atomic.compare_exchange( value, value + 1 )) {
+      spin_pause();
+    }
+  }
+}
+
+/* Increments the counter under the mutex.
+ */
+
+static void locked( ULONG, void* )
+{
+  ULONG i;
+
+  for( i = 0; i < iterations; i++ ) {
+    PMLock<PMFastMutex> lock( mutex );
+    ++counter;
+  }
+}
+
+int main( int argc, char* argv[] )
+{
+  ULONG threads = 4;
+  ULONG count;
+
+  if( argc > 1 ) {
+    threads = atol( argv[1] );
+  }
+  if( argc > 2 ) {
+    iterations = atol( argv[2] );
+  }
+  if( !threads || !iterations ) {
+    fprintf( stderr, "Usage: atombench [threads [iterations]]\n" );
+    return 1;
+  }
+
+  printf( "%lu increments per thread\n\n", iterations );
+  printf( "threads    fetch_add, ms    compare_exchange, ms    PMFastMutex, ms\n" );
+
+  for( count = 1; count; count = bench_next( count, threads ))
+  {
+    ULONG add_ms;
+    ULONG cas_ms;
+    ULONG lock_ms;
+
+    atomic.store( 0 );
+    add_ms = bench_run( count, add, NULL );
+    cas_ms = bench_run( count, cas, NULL );
+    counter = 0;
+    lock_ms = bench_run( count, locked, NULL );
+
+    printf( "%7lu %16lu %23lu %18lu%s\n", count, add_ms, cas_ms, lock_ms,
+            atomic.load() == 2 * count * iterations &&
+            counter == count * iterations ? "" : " (lost increments)" );
+  }
+
+  return 0;
+}
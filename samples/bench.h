@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "pm_os2.h"
+#include "pm_thread.h"
+#include "pm_notify.h"
+
+/* Common helpers of the benchmark programs.
+ */
+
+typedef void (*bench_fn)( ULONG index, void* arg );
+
+/* Returns the current time in milliseconds.
+ */
+
+inline ULONG bench_now()
+{
+  ULONG ms;
+  DosQuerySysInfo( QSV_MS_COUNT, QSV_MS_COUNT, &ms, sizeof( ms ));
+  return ms;
+}
+
+class BenchThread : public PMThread
+{
+  public:
+    BenchThread( bench_fn fn, ULONG index, void* arg, PMNotify& go )
+    : m_fn( fn ), m_index( index ), m_arg( arg ), m_go( go ) {
+      message_queue( FALSE );
+    }
+  protected:
+    virtual void operator()() {
+      m_go.wait();
+      m_fn( m_index, m_arg );
+    }
+  private:
+    bench_fn  m_fn;
+    ULONG     m_index;
+    void*     m_arg;
+    PMNotify& m_go;
+};
+
+/* Executes the function by the specified number of threads at
+ * the same time and returns the time spent in milliseconds.
+ */
+
+inline ULONG bench_run( ULONG threads, bench_fn fn, void* arg )
+{
+  BenchThread** workers = new BenchThread*[threads];
+  PMNotify      go;
+  ULONG         start;
+  ULONG         i;
+
+  // The threads are started first and wait for the signal,
+  // so the time of their creation isn't measured.
+  for( i = 0; i < threads; i++ ) {
+    workers[i] = new BenchThread( fn, i, arg, go );
+    workers[i]->start();
+  }
+
+  start = bench_now();
+  go.post();
+
+  for( i = 0; i < threads; i++ ) {
+    workers[i]->join();
+    delete workers[i];
+  }
+
+  delete[] workers;
+  return bench_now() - start;
+}
+
+/* Returns the next number of the threads doubled up to the maximum
+ * or zero after the maximum.
+ */
+
+inline ULONG bench_next( ULONG count, ULONG max )
+{
+  if( count >= max ) {
+    return 0;
+  }
+
+  return count * 2 < max ? count * 2 : max;
+}
+
+#endif
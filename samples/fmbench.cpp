@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+/*
+ * Compares PMFastMutex with PMMutex under contention.
+ *
+ * Each thread increments a shared counter under the mutex and does
+ * a little work outside of it, like the threads sharing a queue.
+ * The test is run by one thread, which shows the cost of the free
+ * mutex, and by several threads at the same time.
+ *
+ * Usage: fmbench [threads [iterations]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pm_os2.h"
+#include "pm_fastmutex.h"
+#include "pm_mutex.h"
+#include "pm_lock.h"
+#include "bench.h"
+
+#define BENCH_WORK 50
+
+static ULONG iterations = 1000000;
+static volatile ULONG counter;
+
+/* Increments the counter under the mutex.
+ */
+
+template <class T> static void increment( ULONG index, void* arg )
+{
+  T& mutex = *(T*)arg;
+  volatile ULONG work = index;
+  ULONG i;
+  ULONG j;
+
+  for( i = 0; i < iterations; i++ )
+  {
+    {
+      PMLock<T> lock( mutex );
+      ++counter;
+    }
+
+    for( j = 0; j < BENCH_WORK; j++ ) {
+      work = work * 3 + 1;
+    }
+  }
+}
+
+int main( int argc, char* argv[] )
+{
+  PMFastMutex fast;
+  PMMutex     kernel;
+  ULONG       threads = 4;
+  ULONG       count;
+
+  if( argc > 1 ) {
+    threads = atol( argv[1] );
+  }
+  if( argc > 2 ) {
+    iterations = atol( argv[2] );
+  }
+  if( !threads || !iterations ) {
+    fprintf( stderr, "Usage: fmbench [threads [iterations]]\n" );
+    return 1;
+  }
+
+  printf( "%lu locks per thread\n\n", iterations );
+  printf( "threads    PMFastMutex, ms    PMMutex, ms\n" );
+
+  for( count = 1; count; count = bench_next( count, threads ))
+  {
+    ULONG fast_ms   = bench_run( count, increment<PMFastMutex>, &fast   );
+    ULONG kernel_ms = bench_run( count, increment<PMMutex>,     &kernel );
+
+    printf( "%7lu %18lu %14lu\n", count, fast_ms, kernel_ms );
+  }
+
+  return 0;
+}
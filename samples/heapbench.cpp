@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+/*
+ * Measures the cost of the PMQueue insert and remove as the queue grows.
+ *
+ * The queue is filled up to the specified depth by the elements of
+ * random priorities, then each iteration removes the first element
+ * and adds a new one, so the depth stays the same. The time of the
+ * heap operations should grow as the logarithm of the depth.
+ *
+ * Usage: heapbench [max_depth [iterations]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pm_os2.h"
+#include "pm_queue.h"
+#include "bench.h"
+
+#define BENCH_PRIORITIES 1024
+
+/* Returns the next pseudo-random priority.
+ */
+
+static ULONG priority( ULONG& seed )
+{
+  seed = seed * 1103515245 + 12345;
+  return ( seed >> 16 ) % BENCH_PRIORITIES;
+}
+
+int main( int argc, char* argv[] )
+{
+  ULONG max_depth  = 65536;
+  ULONG iterations = 1000000;
+  ULONG depth;
+
+  if( argc > 1 ) {
+    max_depth = atol( argv[1] );
+  }
+  if( argc > 2 ) {
+    iterations = atol( argv[2] );
+  }
+  if( max_depth < 16 || !iterations ) {
+    fprintf( stderr, "Usage: heapbench [max_depth [iterations]]\n" );
+    return 1;
+  }
+
+  printf( "%lu reads and writes of random priorities\n\n", iterations );
+  printf( "  depth    time, ms    ns per pair\n" );
+
+  for( depth = 16; depth; depth = bench_next( depth, max_depth ))
+  {
+    PMQueue queue;
+    ULONG   seed = 1;
+    ULONG   request;
+    ULONG   start;
+    ULONG   ms;
+    ULONG   i;
+
+    for( i = 0; i < depth; i++ ) {
+      queue.write( i, NULL, priority( seed ));
+    }
+
+    start = bench_now();
+
+    for( i = 0; i < iterations; i++ ) {
+      queue.read( &request );
+      queue.write( request, NULL, priority( seed ));
+    }
+
+    ms = bench_now() - start;
+    printf( "%7lu %11lu %14lu\n", depth, ms,
+            (ULONG)((double)ms * 1000000 / iterations ));
+  }
+
+  return 0;
+}
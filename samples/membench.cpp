@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+/*
+ * Compares the small block allocator of the PM library with the
+ * allocator of the C runtime.
+ *
+ * Each thread keeps a window of the allocated blocks and replaces them
+ * one by one by the blocks of other size, which resembles the queue
+ * nodes, strings and records of a busy application. The test is run
+ * by one thread and by several threads at the same time.
+ *
+ * Usage: membench [threads [iterations]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pm_os2.h"
+#include "pm_memory.h"
+#include "bench.h"
+
+#define BENCH_WINDOW 1024
+#define BENCH_SIZES  16
+
+// The sizes of the blocks, mostly the ones under 64 bytes.
+static const size_t block_size[BENCH_SIZES] = {
+  8, 12, 16, 16, 24, 24, 32, 32, 40, 48, 48, 64, 96, 128, 200, 256
+};
+
+static ULONG iterations = 1000000;
+
+/* Replaces the blocks by the specified allocator.
+ */
+
+static void run( ULONG index, void* arg )
+{
+  BOOL  pool = *(BOOL*)arg;
+  void* window[BENCH_WINDOW];
+  ULONG seed = index + 1;
+  ULONG i;
+
+  memset( window, 0, sizeof( window ));
+
+  for( i = 0; i < iterations; i++ )
+  {
+    ULONG  slot = i % BENCH_WINDOW;
+    size_t size;
+
+    seed = seed * 1103515245UL + 12345;
+    size = block_size[( seed >> 16 ) % BENCH_SIZES ];
+
+    if( pool ) {
+      xfree( window[slot] );
+      window[slot] = xmalloc( size );
+    } else {
+      free( window[slot] );
+      window[slot] = malloc( size );
+    }
+
+    // Touches the block like the code filling it would do.
+    *(char*)window[slot] = (char)i;
+  }
+
+  for( i = 0; i < BENCH_WINDOW; i++ ) {
+    if( pool ) {
+      xfree( window[i] );
+    } else {
+      free( window[i] );
+    }
+  }
+}
+
+int main( int argc, char* argv[] )
+{
+  ULONG threads = 4;
+  ULONG count;
+
+  if( argc > 1 ) {
+    threads = atol( argv[1] );
+  }
+  if( argc > 2 ) {
+    iterations = atol( argv[2] );
+  }
+  if( !threads || !iterations ) {
+    fprintf( stderr, "Usage: membench [threads [iterations]]\n" );
+    return 1;
+  }
+
+  #if !PM_MEMORY_POOL
+  printf( "The pools are disabled, xmalloc uses the C runtime.\n" );
+  #endif
+
+  printf( "%lu allocations of 8 to 256 bytes per thread\n\n", iterations );
+  printf( "threads    xmalloc, ms    malloc, ms\n" );
+
+  for( count = 1; count; count = bench_next( count, threads ))
+  {
+    BOOL  pool    = TRUE;
+    BOOL  runtime = FALSE;
+    ULONG pool_ms = bench_run( count, run, &pool    );
+    ULONG crt_ms  = bench_run( count, run, &runtime );
+
+    printf( "%7lu %14lu %13lu\n", count, pool_ms, crt_ms );
+  }
+
+  return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+/*
+ * Measures how the readers of PMSeqLock and PMSnapshotPtr scale.
+ *
+ * The specified number of threads read a small shared value while
+ * one more thread replaces it every millisecond. The same is done
+ * with the value guarded by PMRWMutex for comparison. The readers
+ * check that each copy is consistent. The test is run by one reader
+ * and by several readers at the same time.
+ *
+ * Usage: readbench [readers [reads]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pm_os2.h"
+#include "pm_seqlock.h"
+#include "pm_snapshot.h"
+#include "pm_rwmutex.h"
+#include "pm_lock.h"
+#include "pm_atomic.h"
+#include "bench.h"
+
+#define BENCH_FIELDS 4
+
+struct config {
+  ULONG field[BENCH_FIELDS];
+};
+
+static ULONG reads = 1000000;
+
+static PMSeqLock<config>     seqlock;
+static PMSnapshotPtr<config> snapshot( new config());
+static PMRWMutex             mutex;
+static config                guarded;
+
+static PMAtomic<ULONG>       running;
+static PMAtomic<ULONG>       broken;
+
+/* Returns the value of the specified version.
+ */
+
+static config version( ULONG n )
+{
+  config value;
+  ULONG  i;
+
+  for( i = 0; i < BENCH_FIELDS; i++ ) {
+    value.field[i] = n;
+  }
+  return value;
+}
+
+/* Checks that the copy isn't mixed from the different versions.
+ */
+
+static void check( const config& value )
+{
+  ULONG i;
+
+  for( i = 1; i < BENCH_FIELDS; i++ ) {
+    if( value.field[i] != value.field[0] ) {
+      broken.fetch_add( 1 );
+      break;
+    }
+  }
+}
+
+/* Reads the value guarded by the sequence lock. The first
+ * thread is the writer.
+ */
+
+static void read_seqlock( ULONG index, void* )
+{
+  ULONG i;
+
+  if( index == 0 ) {
+    for( i = 1; running.load(); i++ ) {
+      seqlock.write( version( i ));
+      DosSleep( 1 );
+    }
+  } else {
+    for( i = 0; i < reads; i++ ) {
+      check( seqlock.read());
+    }
+    running.fetch_sub( 1 );
+  }
+}
+
+/* Reads the value published by the snapshot pointer. The first
+ * thread is the writer.
+ */
+
+static void read_snapshot( ULONG index, void* )
+{
+  ULONG i;
+
+  if( index == 0 ) {
+    for( i = 1; running.load(); i++ ) {
+      snapshot.update( new config( version( i )));
+      DosSleep( 1 );
+    }
+  } else {
+    for( i = 0; i < reads; i++ ) {
+      PMSnapshotPtr<config>::reader value( snapshot );
+      check( *value );
+    }
+    running.fetch_sub( 1 );
+  }
+}
+
+/* Reads the value guarded by the read/write mutex. The first
+ * thread is the writer.
+ */
+
+static void read_mutex( ULONG index, void* )
+{
+  ULONG i;
+
+  if( index == 0 ) {
+    for( i = 1; running.load(); i++ ) {
+      {
+        PMLock<PMRWMutex> lock( mutex );
+        guarded = version( i );
+      }
+      DosSleep( 1 );
+    }
+  } else {
+    for( i = 0; i < reads; i++ ) {
+      PMSharedLock<PMRWMutex> lock( mutex );
+      check( guarded );
+    }
+    running.fetch_sub( 1 );
+  }
+}
+
+/* Runs the specified readers and the writer and returns
+ * the number of the reads per millisecond.
+ */
+
+static ULONG measure( ULONG readers, bench_fn fn )
+{
+  ULONG ms;
+
+  running.store( readers );
+  ms = bench_run( readers + 1, fn, NULL );
+  return (ULONG)((double)readers * reads / ( ms ? ms : 1 ));
+}
+
+int main( int argc, char* argv[] )
+{
+  ULONG readers = 4;
+  ULONG count;
+
+  if( argc > 1 ) {
+    readers = atol( argv[1] );
+  }
+  if( argc > 2 ) {
+    reads = atol( argv[2] );
+  }
+  if( !readers || !reads ) {
+    fprintf( stderr, "Usage: readbench [readers [reads]]\n" );
+    return 1;
+  }
+
+  printf( "%lu reads per thread, reads per ms\n\n", reads );
+  printf( "readers      PMSeqLock    PMSnapshotPtr      PMRWMutex\n" );
+
+  for( count = 1; count; count = bench_next( count, readers ))
+  {
+    ULONG seq_rate  = measure( count, read_seqlock  );
+    ULONG snap_rate = measure( count, read_snapshot );
+    ULONG rw_rate   = measure( count, read_mutex    );
+
+    printf( "%7lu %14lu %16lu %14lu\n", count, seq_rate, snap_rate, rw_rate );
+  }
+
+  if( broken.load()) {
+    printf( "\n%lu inconsistent reads\n", broken.load());
+  }
+
+  return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+/*
+ * Compares the throughput of PMRingQueue and PMQueue.
+ *
+ * One thread writes the numbers into the queue and another thread
+ * reads them back, so both queues are used as a single producer
+ * single consumer channel. The test is repeated for the ring buffers
+ * of the different capacity.
+ *
+ * Usage: ringbench [elements]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pm_os2.h"
+#include "pm_queue.h"
+#include "pm_ringqueue.h"
+#include "bench.h"
+
+static ULONG elements = 1000000;
+static ULONG checksum;
+
+/* Passes the elements through the ring buffer. The first thread
+ * is a producer and the second one is a consumer.
+ */
+
+static void ring( ULONG index, void* arg )
+{
+  PMRingQueue<ULONG>& queue = *(PMRingQueue<ULONG>*)arg;
+  ULONG value;
+  ULONG sum = 0;
+  ULONG i;
+
+  if( index == 0 ) {
+    for( i = 0; i < elements; i++ ) {
+      queue.push( i );
+    }
+  } else {
+    for( i = 0; i < elements; i++ ) {
+      queue.pop( value );
+      sum += value;
+    }
+    checksum = sum;
+  }
+}
+
+/* Passes the elements through the queue. The first thread
+ * is a producer and the second one is a consumer.
+ */
+
+static void fifo( ULONG index, void* arg )
+{
+  PMQueue& queue = *(PMQueue*)arg;
+  ULONG value;
+  ULONG sum = 0;
+  ULONG i;
+
+  if( index == 0 ) {
+    for( i = 0; i < elements; i++ ) {
+      queue.write( i );
+    }
+  } else {
+    for( i = 0; i < elements; i++ ) {
+      queue.read( &value );
+      sum += value;
+    }
+    checksum = sum;
+  }
+}
+
+int main( int argc, char* argv[] )
+{
+  ULONG capacity;
+  ULONG expected = 0;
+  ULONG ms;
+  ULONG i;
+
+  if( argc > 1 ) {
+    elements = atol( argv[1] );
+  }
+  if( !elements ) {
+    fprintf( stderr, "Usage: ringbench [elements]\n" );
+    return 1;
+  }
+
+  for( i = 0; i < elements; i++ ) {
+    expected += i;
+  }
+
+  printf( "%lu elements from one thread to another\n\n", elements );
+  printf( "queue              time, ms    elements per ms\n" );
+
+  {
+    PMQueue queue;
+
+    ms = bench_run( 2, fifo, &queue );
+    printf( "PMQueue          %10lu %18lu%s\n", ms, ms ? elements / ms : elements,
+            checksum == expected ? "" : " (lost elements)" );
+  }
+
+  for( capacity = 16; capacity <= 4096; capacity *= 4 )
+  {
+    PMRingQueue<ULONG> queue( capacity );
+
+    ms = bench_run( 2, ring, &queue );
+    printf( "PMRingQueue %4lu %10lu %18lu%s\n", capacity, ms, ms ? elements / ms : elements,
+            checksum == expected ? "" : " (lost elements)" );
+  }
+
+  return 0;
+}
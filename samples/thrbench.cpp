@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+/*
+ * Measures the thread start latency in a Presentation Manager process.
+ *
+ * A thread of the PM process creates its message queue at start
+ * unless it is told not to, and then the creation of the message
+ * queue is deferred until the thread asks for it. The test starts
+ * and joins the threads which create the message queue, which skip
+ * it and which skip it but ask for the anchor block later.
+ *
+ * The program must be linked as a PM application, otherwise no
+ * message queue is created at all. The results are written to the
+ * standard output and shown in a message box.
+ *
+ * Usage: thrbench [threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pm_os2.h"
+#include "pm_gui.h"
+#include "bench.h"
+
+class Starter : public PMThread
+{
+  public:
+    Starter( BOOL queue, BOOL use ) : m_use( use ) {
+      message_queue( queue );
+    }
+  protected:
+    virtual void operator()() {
+      if( m_use ) {
+        PMGUI::hab();
+      }
+    }
+  private:
+    BOOL m_use;
+};
+
+/* Starts and joins the specified number of threads one by one.
+ * Returns the time spent in the start calls and the total time
+ * in milliseconds.
+ */
+
+static void measure( ULONG threads, BOOL queue, BOOL use, ULONG* start_ms, ULONG* total_ms )
+{
+  ULONG start = bench_now();
+  ULONG spent = 0;
+  ULONG i;
+
+  for( i = 0; i < threads; i++ )
+  {
+    Starter thread( queue, use );
+    ULONG   called = bench_now();
+
+    thread.start();
+    spent += bench_now() - called;
+    thread.join();
+  }
+
+  *start_ms = spent;
+  *total_ms = bench_now() - start;
+}
+
+int main( int argc, char* argv[] )
+{
+  PMGUI gui;
+  ULONG threads = 1000;
+  ULONG start_ms;
+  ULONG total_ms;
+  char  text[512];
+  int   len;
+
+  if( argc > 1 ) {
+    threads = atol( argv[1] );
+  }
+  if( !threads ) {
+    fprintf( stderr, "Usage: thrbench [threads]\n" );
+    return 1;
+  }
+
+  if( PMGUI::ptype() != PT_PM ) {
+    fprintf( stderr, "thrbench must be linked as a PM application\n" );
+    return 1;
+  }
+
+  len = sprintf( text, "%lu threads started and joined\n\n", threads );
+  len += sprintf( text + len, "message queue       start, ms    total, ms\n" );
+
+  measure( threads, TRUE,  FALSE, &start_ms, &total_ms );
+  len += sprintf( text + len, "created         %13lu %12lu\n", start_ms, total_ms );
+  measure( threads, FALSE, FALSE, &start_ms, &total_ms );
+  len += sprintf( text + len, "deferred        %13lu %12lu\n", start_ms, total_ms );
+  measure( threads, FALSE, TRUE,  &start_ms, &total_ms );
+  len += sprintf( text + len, "deferred, used  %13lu %12lu\n", start_ms, total_ms );
+
+  printf( "%s", text );
+  WinMessageBox( HWND_DESKTOP, HWND_DESKTOP, text, "Thread start latency",
+                 0, MB_OK | MB_INFORMATION | MB_MOVEABLE );
+  return 0;
+}
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+/*
+ * Measures the windows set with a large number of registered windows.
+ *
+ * The specified number of window handles are inserted into the set,
+ * then they are queried by one or several threads at the same time,
+ * as the window procedures of the different threads do, and removed.
+ * The handles are not real windows, so no window is created.
+ *
+ * Usage: wsbench [windows [threads [queries]]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "pm_os2.h"
+#include "pm_windowset.h"
+#include "bench.h"
+
+static ULONG windows = 10000;
+static ULONG queries = 1000000;
+static ULONG missed;
+
+/* Returns the fake window handle of the specified number. The PM window
+ * handles differ mostly in the low bits, so the fake ones do the same.
+ */
+
+static HWND handle( ULONG i ) {
+  return (HWND)( 0x80000000UL | (( i + 1 ) << 1 ));
+}
+
+/* Queries the registered windows.
+ */
+
+static void lookup( ULONG index, void* )
+{
+  ULONG miss = 0;
+  ULONG i;
+
+  for( i = 0; i < queries; i++ )
+  {
+    ULONG n = ( i * 7 + index ) % windows;
+
+    if( PMWindowSet::query( handle( n )) != (PMWindow*)( n + 1 )) {
+      ++miss;
+    }
+  }
+
+  if( miss ) {
+    missed = miss;
+  }
+}
+
+int main( int argc, char* argv[] )
+{
+  ULONG threads = 4;
+  ULONG count;
+  ULONG start;
+  ULONG ms;
+  ULONG i;
+
+  if( argc > 1 ) {
+    windows = atol( argv[1] );
+  }
+  if( argc > 2 ) {
+    threads = atol( argv[2] );
+  }
+  if( argc > 3 ) {
+    queries = atol( argv[3] );
+  }
+  if( !windows || !threads || !queries ) {
+    fprintf( stderr, "Usage: wsbench [windows [threads [queries]]]\n" );
+    return 1;
+  }
+
+  printf( "%lu windows\n\n", windows );
+
+  start = bench_now();
+  for( i = 0; i < windows; i++ ) {
+    PMWindowSet::insert( handle( i ), (PMWindow*)( i + 1 ));
+  }
+  ms = bench_now() - start;
+  printf( "insert all:  %8lu ms\n", ms );
+
+  start = bench_now();
+  for( i = 0; i < queries; i++ ) {
+    PMWindowSet::query( handle( windows + i % windows ));
+  }
+  ms = bench_now() - start;
+  printf( "%lu queries of unknown windows: %lu ms\n\n", queries, ms );
+
+  printf( "%lu queries per thread\n\n", queries );
+  printf( "threads    time, ms\n" );
+
+  for( count = 1; count; count = bench_next( count, threads )) {
+    printf( "%7lu %11lu\n", count, bench_run( count, lookup, NULL ));
+  }
+
+  if( missed ) {
+    printf( "\nsome windows were not found\n" );
+  }
+
+  start = bench_now();
+  for( i = 0; i < windows; i++ ) {
+    PMWindowSet::remove( handle( i ));
+  }
+  ms = bench_now() - start;
+  printf( "\nremove all:  %8lu ms\n", ms );
+
+  return 0;
+}
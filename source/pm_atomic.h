@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_ATOMIC_H
+#define PM_ATOMIC_H
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_smp.h"
+
+/**
+ * Memory orders of the atomic operations.
+ *
+ * PM_RELAXED guarantees only atomicity of the operation,
+ * PM_ACQUIRE keeps the subsequent memory accesses after a load,
+ * PM_RELEASE keeps the preceding memory accesses before a store,
+ * PM_ACQ_REL combines both for the read-modify-write operations
+ * and PM_SEQ_CST additionally gives a single total order of all
+ * sequentially consistent operations.
+ *
+ * The values are the same as the GCC __ATOMIC_* constants.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_RELAXED 0
+#define PM_ACQUIRE 2
+#define PM_RELEASE 3
+#define PM_ACQ_REL 4
+#define PM_SEQ_CST 5
+
+/**
+ * Atomic variable class.
+ *
+ * The PMAtomic class template provides the atomic operations on a value
+ * of an integral or pointer type with an explicit memory order. By default
+ * all operations are sequentially consistent.
+ *
+ * The GCC and Clang compilers implement the operations by their __atomic
+ * built-in functions. The Open Watcom compiler implements them by the
+ * instructions of pm_smp.h and supports only the 32-bit types. On x86
+ * processors the loads have the acquire and the stores have the release
+ * semantics by themselves, so only the sequentially consistent store
+ * needs the locked instruction there.
+ *
+ * The <i>fetch_add</i> and <i>fetch_sub</i> methods are available only
+ * for the integral types.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+template <class T> class PMAtomic : public PMNonCopyable
+{
+  public:
+
+    /** Constructs the atomic variable. */
+    PMAtomic( T value = T()) : m_value( value ) {}
+
+    /** Atomically loads and returns the value. */
+    T load( int order = PM_SEQ_CST ) const;
+    /** Atomically stores the value. */
+    void store( T value, int order = PM_SEQ_CST );
+    /** Atomically replaces the value and returns the previous one. */
+    T exchange( T value, int order = PM_SEQ_CST );
+
+    /**
+     * Atomically compares and exchanges the value.
+     *
+     * Stores <i>desired</i> if the current value is equal to
+     * <i>expected</i>, otherwise stores the current value into
+     * <i>expected</i>.
+     *
+     * @return TRUE, if the value is replaced.
+     */
+
+    BOOL compare_exchange( T& expected, T desired, int order = PM_SEQ_CST );
+
+    /** Atomically adds to the value and returns the previous one. */
+    T fetch_add( T value, int order = PM_SEQ_CST );
+    /** Atomically subtracts from the value and returns the previous one. */
+    T fetch_sub( T value, int order = PM_SEQ_CST );
+
+  private:
+    volatile T m_value;
+};
+
+#if defined( __GNUC__ )
+
+/**
+ * Memory fence.
+ *
+ * Orders the memory accesses preceding the fence relative
+ * to the following ones according to the memory order.
+ */
+
+inline void atomic_fence( int order ) {
+  __atomic_thread_fence( order );
+}
+
+/* Atomically loads and returns the value.
+ */
+
+template <class T> inline
+T PMAtomic<T>::load( int order ) const {
+  return __atomic_load_n( &m_value, order );
+}
+
+/* Atomically stores the value.
+ */
+
+template <class T> inline
+void PMAtomic<T>::store( T value, int order ) {
+  __atomic_store_n( &m_value, value, order );
+}
+
+/* Atomically replaces the value and returns the previous one.
+ */
+
+template <class T> inline
+T PMAtomic<T>::exchange( T value, int order ) {
+  return __atomic_exchange_n( &m_value, value, order );
+}
+
+/* Atomically compares and exchanges the value.
+ */
+
+template <class T> inline
+BOOL PMAtomic<T>::compare_exchange( T& expected, T desired, int order )
+{
+  // The failure order can't be a release one.
+  int failure = order == PM_ACQ_REL ? PM_ACQUIRE :
+                order == PM_RELEASE ? PM_RELAXED : order;
+
+  return __atomic_compare_exchange_n( &m_value, &expected, desired,
+                                      false, order, failure );
+}
+
+/* Atomically adds to the value and returns the previous one.
+ */
+
+template <class T> inline
+T PMAtomic<T>::fetch_add( T value, int order ) {
+  return __atomic_fetch_add( &m_value, value, order );
+}
+
+/* Atomically subtracts from the value and returns the previous one.
+ */
+
+template <class T> inline
+T PMAtomic<T>::fetch_sub( T value, int order ) {
+  return __atomic_fetch_sub( &m_value, value, order );
+}
+
+#else
+
+/**
+ * Memory fence.
+ *
+ * Orders the memory accesses preceding the fence relative
+ * to the following ones according to the memory order.
+ */
+
+inline void atomic_fence( int )
+{
+  // The locked instruction is a full fence for both the processor
+  // and the compiler, which assumes that it modifies the memory.
+  unsigned int fence = 0;
+  xchg( &fence, 0 );
+}
+
+/* Atomically loads and returns the value.
+ */
+
+template <class T> inline
+T PMAtomic<T>::load( int ) const {
+  return m_value;
+}
+
+/* Atomically stores the value.
+ */
+
+template <class T> inline
+void PMAtomic<T>::store( T value, int order )
+{
+  if( order == PM_SEQ_CST ) {
+    xchg((T&)m_value, value );
+  } else {
+    m_value = value;
+  }
+}
+
+/* Atomically replaces the value and returns the previous one.
+ */
+
+template <class T> inline
+T PMAtomic<T>::exchange( T value, int ) {
+  return xchg((T&)m_value, value );
+}
+
+/* Atomically compares and exchanges the value.
+ */
+
+template <class T> inline
+BOOL PMAtomic<T>::compare_exchange( T& expected, T desired, int )
+{
+  T current = cmpxchg((T&)m_value, desired, expected );
+
+  if( current == expected ) {
+    return TRUE;
+  }
+
+  expected = current;
+  return FALSE;
+}
+
+/* Atomically adds to the value and returns the previous one.
+ */
+
+template <class T> inline
+T PMAtomic<T>::fetch_add( T value, int ) {
+  return xadd((T&)m_value, value );
+}
+
+/* Atomically subtracts from the value and returns the previous one.
+ */
+
+template <class T> inline
+T PMAtomic<T>::fetch_sub( T value, int ) {
+  return xadd((T&)m_value, (T)( 0 - value ));
+}
+
+#endif
+#endif
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#include "pm_barrier.h"
+#include "pm_lock.h"
+
+/* Constructs the barrier for the specified number of threads.
+ */
+
+PMBarrier::PMBarrier( ULONG parties )
+
+: m_parties( parties ),
+  m_left   ( parties ),
+  m_phase  ( 0       )
+{}
+
+/* Waits until all threads reach the barrier.
+ */
+
+BOOL PMBarrier::arrive_and_wait()
+{
+  PMLock<PMFastMutex> lock( m_mutex );
+  ULONG phase = m_phase;
+
+  if( --m_left == 0 ) {
+    m_left = m_parties;
+    ++m_phase;
+    m_passed.broadcast();
+    return TRUE;
+  }
+
+  // The phase protects against returning before the barrier
+  // is passed if a thread is woken up by a later signal.
+  while( phase == m_phase ) {
+    m_passed.wait( m_mutex );
+  }
+
+  return FALSE;
+}
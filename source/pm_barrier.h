@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_BARRIER_H
+#define PM_BARRIER_H
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_fastmutex.h"
+#include "pm_condition.h"
+
+/**
+ * Reusable thread barrier.
+ *
+ * The PMBarrier class blocks a fixed number of threads until
+ * all of them reach the barrier. The last arriving thread doesn't
+ * block: it wakes up the threads of the current phase only and
+ * starts the next phase, so the barrier can be used again at once.
+ *
+ * None of the functions in this class throws exceptions because
+ * an exception probably has been thrown already or is about
+ * to be thrown.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+class PMBarrier : public PMNonCopyable
+{
+  public:
+    /** Constructs the barrier for the specified number of threads. */
+    PMBarrier( ULONG parties );
+
+    /**
+     * Waits until all threads reach the barrier.
+     *
+     * @return TRUE for the last arriving thread and FALSE
+     *         for the other ones.
+     */
+
+    BOOL arrive_and_wait();
+
+    /** Returns the number of the threads synchronized by the barrier. */
+    ULONG parties() const { return m_parties; }
+
+  private:
+    ULONG       m_parties;
+    ULONG       m_left;
+    ULONG       m_phase;
+    PMFastMutex m_mutex;
+    PMCondition m_passed;
+};
+
+#endif
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#include "pm_condition.h"
+#include "pm_lock.h"
+
+/* Constructs the condition variable.
+ */
+
+PMCondition::PMCondition()
+
+: m_head( NULL ),
+  m_tail( NULL ),
+  m_free( NULL )
+{}
+
+/* Destructs the condition variable.
+ */
+
+PMCondition::~PMCondition()
+{
+  QWaiter* waiter;
+
+  while(( waiter = m_free ) != NULL ) {
+    m_free = waiter->m_next;
+    delete waiter;
+  }
+}
+
+/* Adds a waiter for the calling thread to the end of the list.
+ */
+
+PMCondition::QWaiter* PMCondition::enqueue()
+{
+  PMLock<PMFastMutex> lock( m_mutex );
+  QWaiter* waiter;
+
+  if( m_free ) {
+    waiter = m_free;
+    m_free = waiter->m_next;
+  } else {
+    waiter = new QWaiter;
+  }
+
+  // The notify is reset before the caller releases its mutex,
+  // therefore a signal issued after that can't be lost.
+  waiter->m_event.reset();
+  waiter->m_blocked = TRUE;
+  waiter->m_next    = NULL;
+
+  if( m_tail ) {
+    m_tail->m_next = waiter;
+  } else {
+    m_head = waiter;
+  }
+
+  m_tail = waiter;
+  return waiter;
+}
+
+/* Blocks the calling thread until its waiter is woken up.
+ */
+
+BOOL PMCondition::sleep( QWaiter* waiter, unsigned long msec )
+{
+  BOOL signaled;
+
+  if( msec == SEM_INDEFINITE_WAIT ) {
+    waiter->m_event.wait();
+  } else {
+    waiter->m_event.wait( msec );
+  }
+
+  PMLock<PMFastMutex> lock( m_mutex );
+
+  if(( signaled = !waiter->m_blocked ) == FALSE ) {
+    // Woken up by timeout, the waiter is still in the list.
+    QWaiter* prev = NULL;
+    QWaiter* curr = m_head;
+
+    while( curr != waiter ) {
+      prev = curr;
+      curr = curr->m_next;
+    }
+
+    if( prev ) {
+      prev->m_next = waiter->m_next;
+    } else {
+      m_head = waiter->m_next;
+    }
+    if( m_tail == waiter ) {
+      m_tail = prev;
+    }
+  }
+
+  waiter->m_next = m_free;
+  m_free = waiter;
+  return signaled;
+}
+
+/* Removes the first waiter from the list and wakes it up.
+ *
+ * Must be called with the internal mutex requested.
+ */
+
+void PMCondition::wakeup()
+{
+  QWaiter* waiter = m_head;
+
+  if(( m_head = waiter->m_next ) == NULL ) {
+    m_tail = NULL;
+  }
+
+  waiter->m_blocked = FALSE;
+  waiter->m_event.post();
+}
+
+/* Waits for the condition.
+ */
+
+BOOL PMCondition::wait( PMFastMutex& mutex ) {
+  return wait( mutex, SEM_INDEFINITE_WAIT );
+}
+
+/* Waits for the condition with timeout.
+ */
+
+BOOL PMCondition::wait( PMFastMutex& mutex, unsigned long msec )
+{
+  QWaiter* waiter = enqueue();
+  BOOL     signaled;
+
+  mutex.release();
+  signaled = sleep( waiter, msec );
+  mutex.request();
+
+  return signaled;
+}
+
+/* Waits for the condition.
+ */
+
+BOOL PMCondition::wait( PMMutex& mutex ) {
+  return wait( mutex, SEM_INDEFINITE_WAIT );
+}
+
+/* Waits for the condition with timeout.
+ */
+
+BOOL PMCondition::wait( PMMutex& mutex, unsigned long msec )
+{
+  QWaiter* waiter = enqueue();
+  BOOL     signaled;
+
+  mutex.release();
+  signaled = sleep( waiter, msec );
+  mutex.request();
+
+  return signaled;
+}
+
+/* Wakes up one waiting thread.
+ */
+
+BOOL PMCondition::signal()
+{
+  if( !m_head ) {
+    return FALSE;
+  }
+
+  PMLock<PMFastMutex> lock( m_mutex );
+
+  if( !m_head ) {
+    return FALSE;
+  }
+
+  wakeup();
+  return TRUE;
+}
+
+/* Wakes up all waiting threads.
+ */
+
+ULONG PMCondition::broadcast()
+{
+  ULONG count = 0;
+
+  if( !m_head ) {
+    return 0;
+  }
+
+  PMLock<PMFastMutex> lock( m_mutex );
+
+  while( m_head ) {
+    wakeup();
+    ++count;
+  }
+
+  return count;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_CONDITION_H
+#define PM_CONDITION_H
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_fastmutex.h"
+#include "pm_mutex.h"
+#include "pm_notify.h"
+
+/**
+ * Condition variable.
+ *
+ * The PMCondition class blocks threads until another thread
+ * changes a state protected by a mutex and signals the condition.
+ * The waiting thread atomically releases the mutex and blocks,
+ * and requests the mutex again before the wait returns.
+ *
+ * Every waiting thread is blocked on its own notify, therefore
+ * <i>signal</i> wakes up exactly one waiting thread, the one that
+ * waits longest, and <i>broadcast</i> wakes up the threads waiting
+ * at the moment of the call only. The notifies are reused, and
+ * signaling a condition without the waiting threads doesn't call
+ * the kernel.
+ *
+ * As with any condition variable, the waiting thread must check
+ * its predicate in a loop after the wait returns.
+ *
+ * None of the functions in this class throws exceptions because
+ * an exception probably has been thrown already or is about
+ * to be thrown.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+class PMCondition : public PMNonCopyable
+{
+  public:
+    /** Constructs the condition variable. */
+    PMCondition();
+    /** Destructs the condition variable. */
+   ~PMCondition();
+
+    /**
+     * Waits for the condition.
+     *
+     * The specified mutex must be requested by the calling thread.
+     * It is released while the thread is blocked and is requested
+     * again before the method returns.
+     *
+     * @return TRUE, if the condition is signaled.
+     */
+
+    BOOL wait( PMFastMutex& mutex );
+
+    /**
+     * Waits for the condition with timeout.
+     *
+     * @param  mutex  The mutex requested by the calling thread.
+     * @param  msec   This is the maximum amount of time the
+     *                user wants to allow the thread to be blocked.
+     *
+     * @return TRUE, if the condition is signaled.
+     */
+
+    BOOL wait( PMFastMutex& mutex, unsigned long msec );
+
+    /**
+     * Waits for the condition.
+     *
+     * The specified mutex must be requested by the calling thread
+     * only once, otherwise it isn't released while the thread waits.
+     *
+     * @return TRUE, if the condition is signaled.
+     */
+
+    BOOL wait( PMMutex& mutex );
+
+    /**
+     * Waits for the condition with timeout.
+     *
+     * @param  mutex  The mutex requested by the calling thread once.
+     * @param  msec   This is the maximum amount of time the
+     *                user wants to allow the thread to be blocked.
+     *
+     * @return TRUE, if the condition is signaled.
+     */
+
+    BOOL wait( PMMutex& mutex, unsigned long msec );
+
+    /**
+     * Wakes up one waiting thread.
+     *
+     * @return TRUE, if a thread was waiting.
+     */
+
+    BOOL signal();
+
+    /**
+     * Wakes up all waiting threads.
+     *
+     * @return The number of the woken threads.
+     */
+
+    ULONG broadcast();
+
+  private:
+
+    struct QWaiter {
+      BOOL     m_blocked;
+      QWaiter* m_next;
+      PMNotify m_event;
+    };
+
+    QWaiter* volatile m_head;
+    QWaiter*          m_tail;
+    QWaiter*          m_free;
+    PMFastMutex       m_mutex;
+
+    /** Adds a waiter for the calling thread to the end of the list. */
+    QWaiter* enqueue();
+    /** Blocks the calling thread until its waiter is woken up. */
+    BOOL sleep( QWaiter* waiter, unsigned long msec );
+    /** Removes the first waiter from the list and wakes it up. */
+    void wakeup();
+};
+
+#endif
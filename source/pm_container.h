@@ -8,6 +8,7 @@
 #include "pm_os2.h"
 #include "pm_window.h"
 #include "pm_memory.h"
+#include "pm_parallel.h"
 
 /**
  * Container control window class.
@@ -532,6 +533,23 @@ class PMContainer : public PMWindow
 
     void sort( SHORT (EXPENTRY * pcompare)( TRecord* p1, TRecord* p2, PMContainer* container ));
 
+    /**
+     * Sorts current container records by several threads.
+     *
+     * The records are compared by the same function as used by the
+     * <i>sort</i> method, but it is called by the threads of PMParallel
+     * and must not access the container window. The found order is
+     * applied by the container control without calling the function
+     * again. The equal records keep their relative order. The inserted
+     * records aren't kept sorted, and the child records of a tree view
+     * are sorted by the container control as usually.
+     *
+     * @param pcompare    Pointer to a comparison function. See the
+     *                    <i>sort</i> method.
+     */
+
+    void parallel_sort( SHORT (EXPENTRY * pcompare)( TRecord* p1, TRecord* p2, PMContainer* container ));
+
     /**
      * Filters the contents of a container so that a subset of the container items is viewable.
      *
@@ -745,6 +763,31 @@ class PMContainer : public PMWindow
     /** Returns a pointer to the column structure. */
     PFIELDINFO column( LONG pos );
 
+    struct QRank {
+      TRecord* m_rec;
+      ULONG    m_rank;
+    };
+
+    struct QSortInfo {
+      SHORT (EXPENTRY * m_compare)( TRecord* p1, TRecord* p2, PMContainer* container );
+      PMContainer* m_container;
+      QRank*       m_ranks;
+      ULONG        m_count;
+
+      /** Compares the records by the comparison function. */
+      BOOL operator()( TRecord* p1, TRecord* p2 ) const {
+        return m_compare( p1, p2, m_container ) < 0;
+      }
+    };
+
+    /** Orders the ranks by the addresses of the records. */
+    static BOOL rank_less( const QRank& r1, const QRank& r2 ) {
+      return r1.m_rec < r2.m_rec;
+    }
+
+    /** Compares the records by their ranks found by the parallel sort. */
+    static SHORT EXPENTRY rank_compare( TRecord* p1, TRecord* p2, void* info );
+
     BOOL  m_is_tree;
     char* m_title;
     LONG  m_cb_data;
@@ -1232,6 +1275,90 @@ inline void PMContainer<TRecord>::sort( SHORT (EXPENTRY * pcompare)( TRecord* p1
   }
 }
 
+/* Sorts current container records by several threads.
+ */
+
+template <class TRecord>
+inline void PMContainer<TRecord>::parallel_sort( SHORT (EXPENTRY * pcompare)( TRecord* p1,
+                                                                             TRecord* p2, PMContainer* container ))
+{
+  unsigned int recs_count = 0;
+  unsigned int recs_size  = 0;
+  TRecord**    recs       = NULL;
+  TRecord*     rec;
+  QSortInfo    info;
+  ULONG        i;
+
+  if( !pcompare ) {
+    return;
+  }
+
+  for( rec = first(); rec; rec = next( rec )) {
+    if( recs_count == recs_size ) {
+      recs_size += 1000;
+      recs = (TRecord**)xrealloc( recs, recs_size * sizeof( TRecord* ));
+    }
+    recs[recs_count++] = rec;
+  }
+
+  info.m_compare   = pcompare;
+  info.m_container = this;
+  info.m_count     = recs_count;
+  info.m_ranks     = (QRank*)xmalloc(( recs_count ? recs_count : 1 ) * sizeof( QRank ));
+
+  ::parallel_sort( recs, recs_count, info );
+
+  // The container control sorts the records by the ranks, which
+  // are looked up by the binary search instead of the comparisons.
+  for( i = 0; i < recs_count; i++ ) {
+    info.m_ranks[i].m_rec  = recs[i];
+    info.m_ranks[i].m_rank = i;
+  }
+
+  xfree( recs );
+  ::parallel_sort( info.m_ranks, recs_count, rank_less );
+
+  send( CM_SORTRECORD, MPFROMP( rank_compare ), MPFROMP( &info ));
+  xfree( info.m_ranks );
+}
+
+/* Compares the records by their ranks found by the parallel sort.
+ */
+
+template <class TRecord>
+SHORT EXPENTRY PMContainer<TRecord>::rank_compare( TRecord* p1, TRecord* p2, void* info )
+{
+  QSortInfo* sort = (QSortInfo*)info;
+  ULONG rank[2];
+  ULONG i;
+
+  for( i = 0; i < 2; i++ )
+  {
+    TRecord* rec = i ? p2 : p1;
+    ULONG    lo  = 0;
+    ULONG    hi  = sort->m_count;
+
+    while( lo < hi ) {
+      ULONG mid = ( lo + hi ) / 2;
+
+      if( sort->m_ranks[mid].m_rec < rec ) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+
+    if( lo == sort->m_count || sort->m_ranks[lo].m_rec != rec ) {
+      // The child records aren't ranked.
+      return sort->m_compare( p1, p2, sort->m_container );
+    }
+
+    rank[i] = sort->m_ranks[lo].m_rank;
+  }
+
+  return rank[0] < rank[1] ? -1 : rank[0] > rank[1];
+}
+
 /* Filters the contents of a container so that a subset of the container
  * items is viewable.
  */
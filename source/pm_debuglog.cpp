@@ -136,6 +136,7 @@ debugmsg( const char* prefix, HWND hwnd, ULONG msg, MPARAM mp1, MPARAM mp2 )
     case PM_SETTEXT:            pszMsg = "PM_SETTEXT";            break;
     case PM_QUERYOBJECT:        pszMsg = "PM_QUERYOBJECT";        break;
     case PM_ALIGN:              pszMsg = "PM_ALIGN";              break;
+    case PM_TASK_END:           pszMsg = "PM_TASK_END";           break;
 
     default:
       snprintf( szBuffer, sizeof( szBuffer ), "%08X", msg );
@@ -16,6 +16,8 @@
 #define PM_ERR_INITIALIZE       2
 #define PM_ERR_SUBCLASS_WINDOW  3
 #define PM_ERR_TOO_MANY_WINDOWS 4
+#define PM_ERR_TOO_MANY_RANGES  5
+#define PM_ERR_PIPELINE_STARTED 6
 #endif
 
 /**
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#include "pm_fastmutex.h"
+#include "pm_gui.h"
+#include "pm_smp.h"
+
+// The notifies of the blocked threads indexed by the thread identifier.
+// A thread blocks on one mutex at a time, so it needs only one of them.
+static PMNotify* events[PM_MAX_THREADS];
+
+/* Constructs the mutual exclusion object.
+ */
+
+PMFastMutex::PMFastMutex()
+
+: m_state     ( 0    ),
+  m_spin      ( 0    ),
+  m_queue_lock( 0    ),
+  m_first     ( NULL ),
+  m_last      ( NULL )
+{
+  // The polling is useless on the uniprocessor systems because the
+  // owner of the mutex can't release it while the current thread runs.
+  if( PMGUI::processors() > 1 ) {
+    m_spin = PM_FASTMUTEX_SPIN;
+  }
+}
+
+/* Polls the busy mutex for a short time.
+ */
+
+BOOL PMFastMutex::spin()
+{
+  ULONG i;
+
+  for( i = 0; i < m_spin; i++ ) {
+    if( m_state == 0 && cmpxchg((ULONG&)m_state, 1UL, 0UL ) == 0 ) {
+      return TRUE;
+    }
+    spin_pause();
+  }
+
+  return FALSE;
+}
+
+/* Requests the queue of the blocked threads.
+ */
+
+void PMFastMutex::lock_queue()
+{
+  ULONG count = 0;
+
+  while( xchg((ULONG&)m_queue_lock, 1UL )) {
+    spin_yield( count );
+  }
+}
+
+/* Releases the queue of the blocked threads.
+ */
+
+void PMFastMutex::unlock_queue() {
+  xchg((ULONG&)m_queue_lock, 0UL );
+}
+
+/* Blocks the calling thread until the mutex is released
+ * or the timeout expires.
+ *
+ * Returns TRUE if the mutex has been taken meanwhile.
+ */
+
+BOOL PMFastMutex::block( unsigned long msec )
+{
+  TID       tid   = PMGUI::tid();
+  PMNotify* local = NULL;
+  BOOL      taken = FALSE;
+  QWaiter   waiter;
+
+  if( tid < PM_MAX_THREADS ) {
+    if( !events[tid] ) {
+      events[tid] = new PMNotify;
+    }
+    waiter.m_event = events[tid];
+  } else {
+    waiter.m_event = local = new PMNotify;
+  }
+
+  waiter.m_event->reset();
+  waiter.m_next  = NULL;
+  waiter.m_woken = FALSE;
+
+  lock_queue();
+
+  if( m_last ) {
+    m_last->m_next = &waiter;
+  } else {
+    m_first = &waiter;
+  }
+  m_last = &waiter;
+
+  unlock_queue();
+
+  // The thread is queued before the state is marked, therefore the
+  // owner releasing the mutex after that finds it in the queue.
+  if( xchg((ULONG&)m_state, 2UL ) == 0 ) {
+    taken = TRUE;
+  } else if( msec == SEM_INDEFINITE_WAIT ) {
+    waiter.m_event->wait();
+  } else {
+    waiter.m_event->wait( msec );
+  }
+
+  lock_queue();
+
+  // The released mutex posts the notify while the queue is requested,
+  // so the notify is not touched after the thread leaves the queue.
+  if( !waiter.m_woken )
+  {
+    QWaiter* prev = NULL;
+    QWaiter* node = m_first;
+
+    while( node != &waiter ) {
+      prev = node;
+      node = node->m_next;
+    }
+
+    if( prev ) {
+      prev->m_next = waiter.m_next;
+    } else {
+      m_first = waiter.m_next;
+    }
+    if( m_last == &waiter ) {
+      m_last = prev;
+    }
+  }
+
+  unlock_queue();
+
+  delete local;
+  return taken;
+}
+
+/* Request access to resource.
+ *
+ * Requests ownership of a resource.
+ * Blocks the calling thread indefinitely.
+ */
+
+BOOL PMFastMutex::request()
+{
+  if( cmpxchg((ULONG&)m_state, 1UL, 0UL ) == 0 || spin()) {
+    return TRUE;
+  }
+
+  while( !block( SEM_INDEFINITE_WAIT ))
+  {}
+
+  return TRUE;
+}
+
+/* Request access to resource with wait timeout.
+ *
+ * Requests ownership of a resource.
+ * Blocks the calling thread.
+ */
+
+BOOL PMFastMutex::request( unsigned long msec )
+{
+  ULONG start;
+  ULONG current;
+
+  if( cmpxchg((ULONG&)m_state, 1UL, 0UL ) == 0 || spin()) {
+    return TRUE;
+  }
+
+  DosQuerySysInfo( QSV_MS_COUNT, QSV_MS_COUNT, &start, sizeof( start ));
+  current = start;
+
+  for(;;) {
+    if( block( msec - ( current - start ))) {
+      return TRUE;
+    }
+
+    DosQuerySysInfo( QSV_MS_COUNT, QSV_MS_COUNT, &current, sizeof( current ));
+
+    if( current - start >= msec ) {
+      // The thread can be woken by the release just after the timeout.
+      // If it gives up, the wakeup would be lost for the other blocked
+      // threads, therefore the state is marked once more: either the
+      // mutex is taken or its owner wakes the next blocked thread.
+      return xchg((ULONG&)m_state, 2UL ) == 0;
+    }
+  }
+}
+
+/* Relinquishes ownership of a resource.
+ *
+ * Only the thread that owns the resource can issue release().
+ * Wakes only the oldest of the blocked threads.
+ */
+
+BOOL PMFastMutex::release()
+{
+  if( xchg((ULONG&)m_state, 0UL ) == 2 )
+  {
+    QWaiter* waiter;
+
+    lock_queue();
+
+    if(( waiter = m_first ) != NULL ) {
+      if(( m_first = waiter->m_next ) == NULL ) {
+        m_last = NULL;
+      }
+
+      waiter->m_woken = TRUE;
+      waiter->m_event->post();
+    }
+
+    unlock_queue();
+  }
+
+  return TRUE;
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_FASTMUTEX_H
+#define PM_FASTMUTEX_H
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_notify.h"
+
+#ifndef PM_FASTMUTEX_SPIN
+
+/**
+ * Sets the number of attempts to take a busy fast mutex
+ * before the requesting thread is blocked.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_FASTMUTEX_SPIN 200
+#endif
+
+/**
+ * Serialize access to resources within a process.
+ *
+ * The PMFastMutex class is a lightweight alternative to the PMMutex
+ * class. The free mutex is taken by one atomic operation without
+ * calling the kernel. The busy mutex is polled for a short time
+ * on the multiprocessor systems and only after that the requesting
+ * thread is blocked. The blocked threads are queued and each release
+ * of the mutex wakes only the oldest of them.
+ *
+ * The OS/2 kernel has no call blocking a thread on a memory word
+ * like the Linux futex, so each blocked thread waits on its own
+ * event semaphore, which is created once for each thread identifier.
+ *
+ * Unlike PMMutex, the fast mutex is not recursive: the thread
+ * that owns the mutex must not request it again. It can be used
+ * together with the PMLock class.
+ *
+ * None of the functions in this class throws exceptions because
+ * an exception probably has been thrown already or is about
+ * to be thrown.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+class PMFastMutex : public PMNonCopyable
+{
+  public:
+    /** Constructs the mutual exclusion object. */
+    PMFastMutex();
+
+    /**
+     * Request access to resource.
+     *
+     * Requests ownership of a resource.
+     * Blocks the calling thread indefinitely.
+     *
+     * @return TRUE, if ownership established.
+     */
+
+    BOOL request();
+
+    /**
+     * Request access to resource with wait timeout.
+     *
+     * Requests ownership of a resource.
+     * Blocks the calling thread.
+     *
+     * @param  msec   this is the maximum amount of time the
+     *                user wants to allow the thread to be blocked.
+     *
+     * @return TRUE, if ownership established.
+     */
+
+    BOOL request( unsigned long msec );
+
+    /**
+     * Relinquishes ownership of a resource that was requested by
+     * <i>request</i>.
+     *
+     * Only the thread that owns the resource can issue release().
+     *
+     * @return TRUE, if ownership relinquished.
+     */
+
+    BOOL release();
+
+  private:
+
+    struct QWaiter {
+      QWaiter*       m_next;
+      PMNotify*      m_event;
+      volatile BOOL  m_woken;
+    };
+
+    // 0 - free, 1 - owned, 2 - owned and there can be blocked threads.
+    volatile ULONG m_state;
+    ULONG          m_spin;
+    volatile ULONG m_queue_lock;
+    QWaiter*       m_first;
+    QWaiter*       m_last;
+
+    /** Polls the busy mutex for a short time. */
+    BOOL spin();
+    /** Blocks the calling thread until the mutex is released or the timeout expires. */
+    BOOL block( unsigned long msec );
+    /** Requests the queue of the blocked threads. */
+    void lock_queue();
+    /** Releases the queue of the blocked threads. */
+    void unlock_queue();
+};
+
+#endif
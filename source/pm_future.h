@@ -0,0 +1,483 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_FUTURE_H
+#define PM_FUTURE_H
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_fastmutex.h"
+#include "pm_notify.h"
+#include "pm_lock.h"
+#include "pm_gui.h"
+#include "pm_memory.h"
+#include "pm_atomic.h"
+
+template <class T> class PMPromise;
+
+/**
+ * Result of an asynchronous operation.
+ *
+ * The PMFuture class template gives access to a value that is
+ * set later, usually by another thread, through the corresponding
+ * PMPromise object. The value can be waited for or a continuation
+ * function can be attached to it by the <i>then</i> methods.
+ *
+ * A continuation is called by the thread that attached it or by the
+ * thread of the specified window. It is delivered as the PM_TASK_END
+ * message posted to the object window of that thread (see
+ * <i>PMGUI::task_window</i>), which is dispatched by any message loop,
+ * including the loops of the modal dialogs. If the thread has no message
+ * queue, the continuation is called by the thread that set the value.
+ *
+ * The type T must have a default constructor and an assignment operator.
+ *
+ * You can construct, destruct, copy, and assign objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+template <class T> class PMFuture
+{
+  friend class PMPromise<T>;
+
+  public:
+
+    /** Continuation function. */
+    typedef void (*continuation)( const T& value, void* arg );
+
+    /** Copy constructor. */
+    PMFuture( const PMFuture<T>& future ) : m_state( future.m_state ) {
+      m_state->add_ref();
+    }
+
+    /** Destructs the future object. */
+   ~PMFuture() {
+      m_state->release();
+    }
+
+    /** Assignment operator. */
+    PMFuture<T>& operator=( const PMFuture<T>& future )
+    {
+      future.m_state->add_ref();
+      m_state->release();
+      m_state = future.m_state;
+      return *this;
+    }
+
+    /** Is the value set. */
+    BOOL ready() const { return m_state->m_ready; }
+
+    /** Waits until the value is set. */
+    void wait() const {
+      m_state->m_event.wait();
+    }
+
+    /**
+     * Waits until the value is set with timeout.
+     *
+     * @return TRUE, if the value is set.
+     */
+
+    BOOL wait( ULONG msec ) const {
+      return m_state->m_event.wait( msec );
+    }
+
+    /** Waits until the value is set and returns it. */
+    const T& get() const {
+      m_state->m_event.wait();
+      return m_state->m_value;
+    }
+
+    /**
+     * Attaches a continuation called by the current thread.
+     *
+     * @param fn    The continuation function.
+     * @param arg   The argument passed to the continuation function.
+     */
+
+    void then( continuation fn, void* arg ) {
+      attach( fn, arg, PMGUI::task_window());
+    }
+
+    /**
+     * Attaches a continuation called by the thread of the window.
+     *
+     * @param fn    The continuation function.
+     * @param arg   The argument passed to the continuation function.
+     * @param hwnd  The window whose thread calls the continuation function.
+     */
+
+    void then( continuation fn, void* arg, HWND hwnd )
+    {
+      PID pid;
+      TID tid;
+
+      if( WinQueryWindowProcess( hwnd, &pid, &tid )) {
+        attach( fn, arg, PMGUI::task_window( tid ));
+      } else {
+        attach( fn, arg, NULLHANDLE );
+      }
+    }
+
+    /**
+     * Creates a future set when all of the specified futures are set.
+     *
+     * The value of the created future is the number of the futures.
+     */
+
+    static PMFuture<ULONG> when_all( const PMFuture<T>* futures, ULONG count );
+
+    /**
+     * Creates a future set when any of the specified futures is set.
+     *
+     * The value of the created future is the index of the first set future.
+     * If the <i>count</i> is zero, the created future is set at once
+     * to 0xFFFFFFFF.
+     */
+
+    static PMFuture<ULONG> when_any( const PMFuture<T>* futures, ULONG count );
+
+  private:
+
+    struct QCall;
+
+    class QState : public PMNonCopyable
+    {
+      public:
+        QState() : m_refs( 1 ), m_ready( FALSE ), m_calls( NULL ) {}
+
+        void add_ref() {
+          m_refs.fetch_add( 1, PM_RELAXED );
+        }
+        void release() {
+          if( m_refs.fetch_sub( 1, PM_ACQ_REL ) == 1 ) {
+            delete this;
+          }
+        }
+
+        PMAtomic<ULONG> m_refs;
+        volatile BOOL   m_ready;
+        T               m_value;
+        QCall*          m_calls;
+        PMFastMutex     m_mutex;
+        PMNotify        m_event;
+    };
+
+    struct QCall {
+      continuation m_fn;
+      void*        m_arg;
+      HWND         m_hwnd;
+      QState*      m_state;
+      QCall*       m_next;
+    };
+
+    struct QJoin;
+
+    struct QIndex {
+      QJoin*            m_join;
+      ULONG             m_index;
+    };
+
+    struct QJoin {
+      PMPromise<ULONG>* m_promise;
+      ULONG             m_count;
+      PMAtomic<ULONG>   m_left;
+      PMAtomic<ULONG>   m_done;
+      PMAtomic<ULONG>   m_calls;
+      QIndex*           m_index;
+    };
+
+    QState* m_state;
+
+    /** Constructs the future object having the specified state. */
+    PMFuture( QState* state ) : m_state( state ) {
+      m_state->add_ref();
+    }
+
+    /** Attaches a continuation called by the thread owning the object window. */
+    void attach( continuation fn, void* arg, HWND hwnd );
+    /** Calls a continuation. */
+    static void invoke( void* call );
+    /** Calls or posts a continuation. */
+    static void schedule( QCall* call );
+    /** Accounts a set future for the when_all method. */
+    static void all_step( const T& value, void* arg );
+    /** Accounts a set future for the when_any method. */
+    static void any_step( const T& value, void* arg );
+    /** Creates the state shared by the when_all and when_any continuations. */
+    static QJoin* join( ULONG count );
+    /** Destroys the shared state after the last continuation. */
+    static void unjoin( QJoin* join );
+};
+
+/**
+ * Provider of a result of an asynchronous operation.
+ *
+ * The PMPromise class template sets the value accessed through
+ * the PMFuture objects returned by the <i>future</i> method.
+ * The value can be set only once.
+ *
+ * You can construct, destruct, copy, and assign objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+template <class T> class PMPromise
+{
+  public:
+
+    /** Constructs the promise object. */
+    PMPromise() : m_state( new typename PMFuture<T>::QState()) {}
+
+    /** Copy constructor. */
+    PMPromise( const PMPromise<T>& promise ) : m_state( promise.m_state ) {
+      m_state->add_ref();
+    }
+
+    /** Destructs the promise object. */
+   ~PMPromise() {
+      m_state->release();
+    }
+
+    /** Assignment operator. */
+    PMPromise<T>& operator=( const PMPromise<T>& promise )
+    {
+      promise.m_state->add_ref();
+      m_state->release();
+      m_state = promise.m_state;
+      return *this;
+    }
+
+    /** Returns the future accessing the value. */
+    PMFuture<T> future() const {
+      return PMFuture<T>( m_state );
+    }
+
+    /**
+     * Sets the value.
+     *
+     * Wakes up the waiting threads and schedules the attached continuations.
+     *
+     * @return FALSE, if the value has been already set.
+     */
+
+    BOOL set( const T& value );
+
+  private:
+    typename PMFuture<T>::QState* m_state;
+};
+
+/* Sets the value.
+ */
+
+template <class T>
+BOOL PMPromise<T>::set( const T& value )
+{
+  typename PMFuture<T>::QCall* calls;
+  typename PMFuture<T>::QCall* next;
+
+  {
+    PMLock<PMFastMutex> lock( m_state->m_mutex );
+
+    if( m_state->m_ready ) {
+      return FALSE;
+    }
+
+    m_state->m_value = value;
+    m_state->m_ready = TRUE;
+    calls = m_state->m_calls;
+    m_state->m_calls = NULL;
+  }
+
+  m_state->m_event.post();
+
+  for( ; calls; calls = next ) {
+    next = calls->m_next;
+    PMFuture<T>::schedule( calls );
+  }
+
+  return TRUE;
+}
+
+/* Attaches a continuation called by the thread owning the message queue.
+ */
+
+template <class T>
+void PMFuture<T>::attach( continuation fn, void* arg, HWND hwnd )
+{
+  QCall* call = new QCall;
+  BOOL   ready;
+
+  call->m_fn    = fn;
+  call->m_arg   = arg;
+  call->m_hwnd  = hwnd;
+  call->m_state = m_state;
+
+  m_state->add_ref();
+
+  {
+    PMLock<PMFastMutex> lock( m_state->m_mutex );
+
+    if(( ready = m_state->m_ready ) == FALSE ) {
+      call->m_next = m_state->m_calls;
+      m_state->m_calls = call;
+    }
+  }
+
+  if( ready ) {
+    schedule( call );
+  }
+}
+
+/* Calls or posts a continuation.
+ */
+
+template <class T>
+void PMFuture<T>::schedule( QCall* call )
+{
+  if( !call->m_hwnd || !WinPostMsg( call->m_hwnd, PM_TASK_END,
+                                    MPFROMP( invoke ), MPFROMP( call )))
+  {
+    invoke( call );
+  }
+}
+
+/* Calls a continuation.
+ */
+
+template <class T>
+void PMFuture<T>::invoke( void* p )
+{
+  QCall* call = (QCall*)p;
+
+  call->m_fn( call->m_state->m_value, call->m_arg );
+  call->m_state->release();
+  delete call;
+}
+
+/* Creates the state shared by the when_all and when_any continuations.
+ */
+
+template <class T>
+typename PMFuture<T>::QJoin* PMFuture<T>::join( ULONG count )
+{
+  QJoin* join = new QJoin;
+  ULONG  i;
+
+  join->m_promise = new PMPromise<ULONG>;
+  join->m_count   = count;
+  join->m_index   = (QIndex*)xmalloc( count * sizeof( QIndex ));
+
+  join->m_left .store( count, PM_RELAXED );
+  join->m_done .store( FALSE, PM_RELAXED );
+  join->m_calls.store( count, PM_RELAXED );
+
+  for( i = 0; i < count; i++ ) {
+    join->m_index[i].m_join  = join;
+    join->m_index[i].m_index = i;
+  }
+
+  return join;
+}
+
+/* Destroys the shared state after the last continuation.
+ */
+
+template <class T>
+void PMFuture<T>::unjoin( QJoin* join )
+{
+  if( join->m_calls.fetch_sub( 1, PM_ACQ_REL ) == 1 ) {
+    xfree( join->m_index );
+    delete join->m_promise;
+    delete join;
+  }
+}
+
+/* Accounts a set future for the when_all method.
+ */
+
+template <class T>
+void PMFuture<T>::all_step( const T&, void* arg )
+{
+  QJoin* join = ((QIndex*)arg)->m_join;
+
+  if( join->m_left.fetch_sub( 1, PM_ACQ_REL ) == 1 ) {
+    join->m_promise->set( join->m_count );
+  }
+
+  unjoin( join );
+}
+
+/* Accounts a set future for the when_any method.
+ */
+
+template <class T>
+void PMFuture<T>::any_step( const T&, void* arg )
+{
+  QJoin* join  = ((QIndex*)arg)->m_join;
+  ULONG  index = ((QIndex*)arg)->m_index;
+
+  if( !join->m_done.exchange( TRUE )) {
+    join->m_promise->set( index );
+  }
+
+  unjoin( join );
+}
+
+/* Creates a future set when all of the specified futures are set.
+ */
+
+template <class T>
+PMFuture<ULONG> PMFuture<T>::when_all( const PMFuture<T>* futures, ULONG count )
+{
+  PMPromise<ULONG> promise;
+  QJoin* join;
+  ULONG  i;
+
+  if( !count ) {
+    promise.set( 0 );
+    return promise.future();
+  }
+
+  join = PMFuture<T>::join( count );
+  promise = *join->m_promise;
+
+  // The continuations are called by the threads setting the values.
+  for( i = 0; i < count; i++ ) {
+    PMFuture<T>( futures[i] ).attach( all_step, &join->m_index[i], NULLHANDLE );
+  }
+
+  return promise.future();
+}
+
+/* Creates a future set when any of the specified futures is set.
+ */
+
+template <class T>
+PMFuture<ULONG> PMFuture<T>::when_any( const PMFuture<T>* futures, ULONG count )
+{
+  PMPromise<ULONG> promise;
+  QJoin* join;
+  ULONG  i;
+
+  if( !count ) {
+    promise.set( 0xFFFFFFFFUL );
+    return promise.future();
+  }
+
+  join = PMFuture<T>::join( count );
+  promise = *join->m_promise;
+
+  // The continuations are called by the threads setting the values.
+  for( i = 0; i < count; i++ ) {
+    PMFuture<T>( futures[i] ).attach( any_step, &join->m_index[i], NULLHANDLE );
+  }
+
+  return promise.future();
+}
+
+#endif
@@ -65,11 +65,63 @@ class PMGUI : public PMNonCopyable
     static TID tid();
     /** Returns the current process identifier. */
     static PID pid();
-    /** Returns the anchor block handle of the current thread. */
+    /** Returns the number of the processors, one if the system can't tell. */
+    static ULONG processors();
+    /**
+     * Returns the anchor block handle of the current thread.
+     *
+     * If the GUI initialization of the current thread is deferred,
+     * it is done by the first call of this method.
+     */
+
     static HAB hab();
-    /** Returns the message queue handle of the current thread. */
+
+    /**
+     * Returns the message queue handle of the current thread.
+     *
+     * If the GUI initialization of the current thread is deferred,
+     * it is done by the first call of this method. Otherwise returns
+     * NULLHANDLE if the GUI facilities are not initialized for the
+     * current thread yet.
+     */
+
     static HMQ hmq();
 
+    /**
+     * Returns the object window of the current thread.
+     *
+     * The window receives the PM_TASK_END messages which call the
+     * completion functions of the thread pool tasks and the continuations
+     * of the futures. Since the messages are addressed to a window, they
+     * are dispatched by any message loop, including the loops of the
+     * modal dialogs.
+     *
+     * Returns NULLHANDLE if the GUI facilities are not initialized
+     * for the current thread yet. The deferred initialization isn't
+     * done by this method, since such thread has no message loop.
+     */
+
+    static HWND task_window();
+
+    /**
+     * Returns the object window of the specified thread.
+     *
+     * Returns NULLHANDLE if the GUI facilities are not
+     * initialized for the specified thread.
+     */
+
+    static HWND task_window( TID tid );
+
+    /**
+     * Defers the GUI initialization of the current thread.
+     *
+     * The specified function is called by the first call of the
+     * <i>hab</i> or <i>hmq</i> method from the current thread. Passing NULL
+     * cancels the deferred initialization.
+     */
+
+    static void defer( void (*initialize)());
+
     /**
      * Returns the current process type code.
      *
@@ -351,6 +403,15 @@ class PMGUI : public PMNonCopyable
     BOOL   m_wrapped;
     static HAB m_hab[PM_MAX_THREADS];
     static HMQ m_hmq[PM_MAX_THREADS];
+    static HWND m_task_window[PM_MAX_THREADS];
+    static void (*m_initialize[PM_MAX_THREADS])();
+
+    /** Does the deferred GUI initialization of the specified thread. */
+    static void initialize( TID tid );
+    /** Creates the object window of the current thread. */
+    static void create_task_window( TID tid );
+    /** Object window procedure. */
+    static MRESULT _System task_proc( HWND, ULONG, MPARAM, MPARAM );
 };
 
 #endif
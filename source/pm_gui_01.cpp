@@ -33,6 +33,7 @@ PMGUI::PMGUI()
   }
 
   m_wrapped = FALSE;
+  create_task_window( cur_tid );
 }
 
 /* Constructs the GUI object from an existing GUI environment.
@@ -49,6 +50,8 @@ PMGUI::PMGUI( HAB hab )
   m_hab[cur_tid] = hab;
   m_hmq[cur_tid] = HMQ_CURRENT;
   m_wrapped      = TRUE;
+
+  create_task_window( cur_tid );
 }
 
 /* Destroys the GUI object.
@@ -61,6 +64,11 @@ PMGUI::~PMGUI()
 {
   TID cur_tid = tid();
 
+  if( m_task_window[cur_tid] ) {
+    WinDestroyWindow( m_task_window[cur_tid] );
+    m_task_window[cur_tid] = NULLHANDLE;
+  }
+
   if( !m_wrapped ) {
     if( m_hmq[cur_tid] ) {
       WinDestroyMsgQueue( m_hmq[cur_tid] );
@@ -74,6 +82,43 @@ PMGUI::~PMGUI()
   }
 }
 
+/* Creates the object window of the current thread.
+ */
+
+void PMGUI::create_task_window( TID tid )
+{
+  static BOOL initialized = FALSE;
+
+  if( !initialized ) {
+    if( !WinRegisterClass( m_hab[tid], PM_TASKWINDOW, task_proc, 0, 0 )) {
+      PM_THROW_GUIERROR();
+    }
+
+    initialized = TRUE;
+  }
+
+  m_task_window[tid] = WinCreateWindow( HWND_OBJECT, PM_TASKWINDOW, NULL, 0, 0, 0, 0, 0,
+                                        NULLHANDLE, HWND_BOTTOM, 0, NULL, NULL );
+  if( !m_task_window[tid] ) {
+    PM_THROW_GUIERROR();
+  }
+}
+
+/* Object window procedure.
+ */
+
+MRESULT _System PMGUI::task_proc( HWND hwnd, ULONG msg, MPARAM mp1, MPARAM mp2 )
+{
+  if( msg == PM_TASK_END ) {
+    // Calls the completion function of the thread pool
+    // task or the continuation of the future.
+    ((void (*)(void*))PVOIDFROMMP( mp1 ))( PVOIDFROMMP( mp2 ));
+    return 0;
+  }
+
+  return WinDefWindowProc( hwnd, msg, mp1, mp2 );
+}
+
 /* Returns a system metric.
  *
  * Allows the application to ask for details about
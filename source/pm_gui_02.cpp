@@ -12,6 +12,9 @@
 
 HAB PMGUI::m_hab[ PM_MAX_THREADS ];
 HMQ PMGUI::m_hmq[ PM_MAX_THREADS ];
+HWND PMGUI::m_task_window[ PM_MAX_THREADS ];
+
+void (*PMGUI::m_initialize[ PM_MAX_THREADS ])();
 
 APIRET APIENTRY DosQueryModFromEIP( HMODULE *phMod, ULONG *pObjNum, ULONG BuffLen,
                                     PCHAR pBuff, ULONG *pOffset, ULONG Address );
@@ -36,6 +39,22 @@ PID PMGUI::pid()
   return ppib->pib_ulpid;
 }
 
+/* Returns the number of the processors.
+ */
+
+ULONG PMGUI::processors()
+{
+  ULONG count;
+
+  if( DosQuerySysInfo( QSV_NUMPROCESSORS, QSV_NUMPROCESSORS,
+                       &count, sizeof( count )) != NO_ERROR || !count )
+  {
+    count = 1;
+  }
+
+  return count;
+}
+
 /* Returns the current process type code.
  */
 
@@ -49,15 +68,63 @@ ULONG PMGUI::ptype()
 /* Returns the anchor block handle of the current thread.
  */
 
-HAB PMGUI::hab() {
-  return m_hab[ tid()];
+HAB PMGUI::hab()
+{
+  TID cur_tid = tid();
+
+  if( !m_hab[ cur_tid ] && m_initialize[ cur_tid ] ) {
+    initialize( cur_tid );
+  }
+
+  return m_hab[ cur_tid ];
 }
 
 /* Returns the message queue handle of the current thread.
  */
 
-HMQ PMGUI::hmq() {
-  return m_hmq[ tid()];
+HMQ PMGUI::hmq()
+{
+  TID cur_tid = tid();
+
+  if( !m_hmq[ cur_tid ] && m_initialize[ cur_tid ] ) {
+    initialize( cur_tid );
+  }
+
+  return m_hmq[ cur_tid ];
+}
+
+/* Does the deferred GUI initialization of the specified thread.
+ */
+
+void PMGUI::initialize( TID tid )
+{
+  void (*fn)() = m_initialize[ tid ];
+
+  // The function is forgotten before the call, so the methods
+  // called by it don't repeat the initialization.
+  m_initialize[ tid ] = NULL;
+  fn();
+}
+
+/* Returns the object window of the current thread.
+ */
+
+HWND PMGUI::task_window() {
+  return m_task_window[ tid()];
+}
+
+/* Returns the object window of the specified thread.
+ */
+
+HWND PMGUI::task_window( TID tid ) {
+  return tid < PM_MAX_THREADS ? m_task_window[ tid ] : NULLHANDLE;
+}
+
+/* Defers the GUI initialization of the current thread.
+ */
+
+void PMGUI::defer( void (*initialize)()) {
+  m_initialize[ tid()] = initialize;
 }
 
 /* Returns the current module handle.
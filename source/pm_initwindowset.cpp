@@ -4,6 +4,7 @@
 
 #include "pm_initwindowset.h"
 #include "pm_windowset.h"
+#include "pm_memory.h"
 
 ULONG PMInitWindowSet::m_initialized = 0;
 
@@ -13,7 +14,7 @@ ULONG PMInitWindowSet::m_initialized = 0;
 PMInitWindowSet::PMInitWindowSet()
 {
   if( !m_initialized++ ) {
-    DosCreateMutexSem( NULL, &PMWindowSet::m_mutex, 0, 0 );
+    PMWindowSet::m_mutex = new PMRWMutex();
   }
 }
 
@@ -23,6 +24,10 @@ PMInitWindowSet::PMInitWindowSet()
 PMInitWindowSet::~PMInitWindowSet()
 {
   if( !--m_initialized ) {
-    DosCloseMutexSem( PMWindowSet::m_mutex );
+    delete PMWindowSet::m_mutex;
+    xfree( PMWindowSet::m_map );
+    PMWindowSet::m_map   = NULL;
+    PMWindowSet::m_size  = 0;
+    PMWindowSet::m_count = 0;
   }
 }
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#include "pm_latch.h"
+#include "pm_smp.h"
+
+/* Constructs the latch expecting the specified number of events.
+ */
+
+PMLatch::PMLatch( ULONG count )
+: m_count( count )
+{
+  if( !m_count ) {
+    m_open.post();
+  }
+}
+
+/* Accounts the specified number of events.
+ */
+
+BOOL PMLatch::count_down( ULONG count )
+{
+  ULONG current = m_count;
+  ULONG found;
+
+  // The counter stops at zero, so the surplus events
+  // can't wrap it around and close the latch again.
+  while( count && current )
+  {
+    ULONG left = current > count ? current - count : 0;
+
+    if(( found = cmpxchg((ULONG&)m_count, left, current )) == current ) {
+      if( !left ) {
+        m_open.post();
+        return TRUE;
+      }
+      break;
+    }
+
+    current = found;
+  }
+
+  return FALSE;
+}
+
+/* Waits until the latch is open.
+ */
+
+BOOL PMLatch::wait() const
+{
+  if( !m_count ) {
+    return TRUE;
+  }
+
+  return m_open.wait();
+}
+
+/* Waits until the latch is open with timeout.
+ */
+
+BOOL PMLatch::wait( unsigned long msec ) const
+{
+  if( !m_count ) {
+    return TRUE;
+  }
+
+  return m_open.wait( msec );
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_LATCH_H
+#define PM_LATCH_H
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_notify.h"
+
+/**
+ * Single use countdown latch.
+ *
+ * The PMLatch class blocks threads until the specified number of
+ * events happen in other threads. Each event is accounted by the
+ * <i>count_down</i> method, which changes the count atomically, and only
+ * the call that decrements the count to zero posts the notify and
+ * releases all waiting threads at once. After that the latch stays
+ * open and the <i>wait</i> method returns immediately.
+ *
+ * None of the functions in this class throws exceptions because
+ * an exception probably has been thrown already or is about
+ * to be thrown.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+class PMLatch : public PMNonCopyable
+{
+  public:
+    /** Constructs the latch expecting the specified number of events. */
+    PMLatch( ULONG count );
+
+    /**
+     * Accounts the specified number of events.
+     *
+     * The events above the number of the expected ones
+     * open the latch and the rest of them are ignored.
+     *
+     * @return TRUE, if the latch is opened by this call.
+     */
+
+    BOOL count_down( ULONG count = 1 );
+
+    /** Is the latch open. */
+    BOOL try_wait() const { return m_count == 0; }
+
+    /**
+     * Waits until the latch is open.
+     *
+     * @return TRUE, if the latch is open.
+     */
+
+    BOOL wait() const;
+
+    /**
+     * Waits until the latch is open with timeout.
+     *
+     * @param  msec   This is the maximum amount of time the
+     *                user wants to allow the thread to be blocked.
+     *
+     * @return TRUE, if the latch is open.
+     */
+
+    BOOL wait( unsigned long msec ) const;
+
+  private:
+    volatile ULONG m_count;
+    PMNotify       m_open;
+};
+
+#endif
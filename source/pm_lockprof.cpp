@@ -0,0 +1,248 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#include <string.h>
+
+#include "pm_lockprof.h"
+#include "pm_lock.h"
+#include "pm_smp.h"
+#include "pm_gui.h"
+#include "pm_debuglog.h"
+
+volatile BOOL  PMLockProfile::m_enabled = FALSE;
+PMLockProfile* PMLockProfile::m_locks   = NULL;
+
+static PMFastMutex locks_mutex;
+static double      timer_frequency = 0;
+
+/* Constructs the statistics of the named lock.
+ */
+
+PMLockProfile::PMLockProfile( const char* name )
+
+: m_name      ( name  ),
+  m_acquired  ( 0     ),
+  m_contended ( 0     ),
+  m_total_wait( 0     ),
+  m_max_wait  ( 0     ),
+  m_long_waits( 0     ),
+  m_owner     ( 0     ),
+  m_holder    ( 0     ),
+  m_released  ( 0     ),
+  m_max_hold  ( 0     ),
+  m_next      ( NULL  )
+{
+  memset( m_hold, 0, sizeof( m_hold ));
+}
+
+/* Enables or disables the profiling.
+ */
+
+void PMLockProfile::enable( BOOL enable )
+{
+  ULONG frequency;
+
+  if( enable && !timer_frequency ) {
+    if( DosTmrQueryFreq( &frequency ) == NO_ERROR && frequency ) {
+      timer_frequency = frequency;
+    } else {
+      // The timer isn't available, the millisecond counter is used.
+      timer_frequency = -1;
+    }
+  }
+
+  m_enabled = enable;
+}
+
+/* Returns the current time in microseconds.
+ */
+
+double PMLockProfile::now()
+{
+  if( timer_frequency > 0 ) {
+    QWORD time;
+    DosTmrQueryTime( &time );
+    return ( time.ulHi * 4294967296.0 + time.ulLo ) * 1000000.0 / timer_frequency;
+  } else {
+    ULONG ms;
+    DosQuerySysInfo( QSV_MS_COUNT, QSV_MS_COUNT, &ms, sizeof( ms ));
+    return ms * 1000.0;
+  }
+}
+
+/* Returns the statistics of the specified lock.
+ */
+
+PMLockProfile* PMLockProfile::find( const char* name )
+{
+  PMLockProfile* lock;
+
+  if( !name ) {
+    name = "unnamed";
+  }
+
+  // The list only grows, so it is searched without the mutex.
+  // The names are usually string literals compared by the address.
+  for( lock = m_locks; lock; lock = lock->m_next ) {
+    if( lock->m_name == name || strcmp( lock->m_name, name ) == 0 ) {
+      return lock;
+    }
+  }
+
+  PMLock<PMFastMutex> lock_list( locks_mutex );
+
+  for( lock = m_locks; lock; lock = lock->m_next ) {
+    if( strcmp( lock->m_name, name ) == 0 ) {
+      return lock;
+    }
+  }
+
+  lock = new PMLockProfile( name );
+  lock->m_next = m_locks;
+  xchg( m_locks, lock );
+  return lock;
+}
+
+/* Accounts an acquisition.
+ */
+
+void PMLockProfile::acquired( double waited, BOOL contended, TID owner )
+{
+  PMLock<PMFastMutex> lock( m_mutex );
+
+  m_holder = PMGUI::tid();
+  ++m_acquired;
+
+  if( contended ) {
+    ++m_contended;
+    m_total_wait += waited;
+
+    if( waited > m_max_wait ) {
+      m_max_wait = waited;
+    }
+    if( waited >= PM_LOCKPROF_LONG_WAIT * 1000.0 ) {
+      ++m_long_waits;
+      if( owner ) {
+        m_owner = owner;
+      }
+    }
+  }
+}
+
+/* Accounts a release of the lock held for the specified time.
+ */
+
+void PMLockProfile::released( double held )
+{
+  PMLock<PMFastMutex> lock( m_mutex );
+  ULONG microseconds = held < 4294967295.0 ? (ULONG)held : 0xFFFFFFFFUL;
+  ULONG bucket;
+
+  for( bucket = 0; bucket < 31 && microseconds >> bucket; bucket++ )
+  {}
+
+  m_holder = 0;
+  ++m_released;
+  ++m_hold[bucket];
+
+  if( held > m_max_hold ) {
+    m_max_hold = held;
+  }
+}
+
+/* Writes the string to the file or to the debug log.
+ */
+
+static void report_line( FILE* file, const char* line )
+{
+  if( file ) {
+    fputs( line, file );
+  } else {
+    DEBUGLOG(( "%s", line ));
+  }
+}
+
+/* Writes the statistics of the lock.
+ */
+
+void PMLockProfile::report_lock( FILE* file )
+{
+  PMLock<PMFastMutex> lock( m_mutex );
+  char  line[256];
+  ULONG median = 0;
+  ULONG p99    = 0;
+  ULONG seen   = 0;
+  ULONG i;
+
+  for( i = 0; i < 32 && m_released; i++ )
+  {
+    // The bucket i contains the hold times less than 2^i microseconds.
+    ULONG bound = i ? ( 1UL << i ) - 1 : 0;
+    seen += m_hold[i];
+
+    if( !median && seen * 2 >= m_released ) {
+      median = bound;
+    }
+    if( seen * 100.0 >= m_released * 99.0 ) {
+      p99 = bound;
+      break;
+    }
+  }
+
+  snprintf( line, sizeof( line ), "lock %s: acquired %lu, contended %lu, wait total %.0f us, "
+            "max %.0f us\n", m_name, m_acquired, m_contended, m_total_wait, m_max_wait );
+  report_line( file, line );
+
+  if( m_released ) {
+    snprintf( line, sizeof( line ), "lock %s: hold median <= %lu us, p99 <= %lu us, max %.0f us\n",
+              m_name, median, p99, m_max_hold );
+    report_line( file, line );
+  }
+
+  if( m_long_waits ) {
+    snprintf( line, sizeof( line ), "lock %s: waits longer than %lu ms %lu, last owner thread %lu\n",
+              m_name, (ULONG)PM_LOCKPROF_LONG_WAIT, m_long_waits, (ULONG)m_owner );
+    report_line( file, line );
+  }
+}
+
+/* Writes the statistics of all profiled locks.
+ */
+
+void PMLockProfile::report( FILE* file )
+{
+  PMLockProfile* lock;
+
+  for( lock = m_locks; lock; lock = lock->m_next ) {
+    lock->report_lock( file );
+  }
+
+  if( file ) {
+    fflush( file );
+  }
+}
+
+/* Purges the statistics of all profiled locks.
+ */
+
+void PMLockProfile::reset()
+{
+  PMLockProfile* lock;
+
+  for( lock = m_locks; lock; lock = lock->m_next )
+  {
+    PMLock<PMFastMutex> lock_stats( lock->m_mutex );
+
+    lock->m_acquired   = 0;
+    lock->m_contended  = 0;
+    lock->m_total_wait = 0;
+    lock->m_max_wait   = 0;
+    lock->m_long_waits = 0;
+    lock->m_owner      = 0;
+    lock->m_released   = 0;
+    lock->m_max_hold   = 0;
+
+    memset( lock->m_hold, 0, sizeof( lock->m_hold ));
+  }
+}
@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_LOCKPROF_H
+#define PM_LOCKPROF_H
+
+#include <stdio.h>
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_fastmutex.h"
+
+#ifndef PM_LOCKPROF_LONG_WAIT
+
+/**
+ * Sets the wait time in milliseconds after which the thread
+ * owning a contended mutex is recorded by the lock profiler.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_LOCKPROF_LONG_WAIT 10
+#endif
+
+#ifndef PM_LOCKPROF_CONTENDED
+
+/**
+ * Sets the wait time in microseconds after which the acquisition
+ * of a resource locked by the PMProfiledLock class is counted as contended.
+ * Used for the resources that can't tell that they are busy.
+ *
+ * Without the high resolution timer the wait is measured by the
+ * millisecond counter, so such an acquisition is counted as contended
+ * only if it has waited for a millisecond tick at least.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_LOCKPROF_CONTENDED 5
+#endif
+
+/**
+ * Lock contention profiler.
+ *
+ * The PMLockProfile class collects the contention statistics of
+ * the named locks: the number of the acquisitions and of the contended
+ * ones, the total and the maximum wait time, the histogram of the hold
+ * time and the thread owning a mutex while another thread waits for it
+ * longer than PM_LOCKPROF_LONG_WAIT. The statistics of the locks having
+ * the same name are summed up.
+ *
+ * The profiling is disabled by default. It is done by the PMMutex
+ * class constructed with a name and by the PMProfiledLock class. While
+ * the profiling is disabled they check a single flag and behave as usual,
+ * so the profiler can stay in the release builds.
+ *
+ * You can't construct objects of this class, use its static methods.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+class PMLockProfile : public PMNonCopyable
+{
+  public:
+
+    /** Enables or disables the profiling. */
+    static void enable( BOOL enable );
+    /** Is the profiling enabled. */
+    static BOOL enabled() { return m_enabled; }
+
+    /**
+     * Writes the statistics of all profiled locks.
+     *
+     * @param file  The file where the report is written, the standard
+     *              error by default. If it is NULL, the report is written
+     *              to the debug log, which exists in the debug builds only.
+     */
+
+    static void report( FILE* file = stderr );
+
+    /** Purges the statistics of all profiled locks. */
+    static void reset();
+
+    /**
+     * Returns the statistics of the specified lock.
+     *
+     * The statistics are created when the lock having this name
+     * is acquired first time while the profiling is enabled.
+     * A lock without a name is profiled as "unnamed".
+     */
+
+    static PMLockProfile* find( const char* name );
+
+    /** Returns the current time in microseconds. */
+    static double now();
+
+    /**
+     * Accounts an acquisition.
+     *
+     * @param waited     The wait time in microseconds.
+     * @param contended  Was the lock busy.
+     * @param owner      The thread owning the lock or 0 if it is unknown.
+     */
+
+    void acquired( double waited, BOOL contended, TID owner );
+
+    /** Accounts a release of the lock held for the specified time in microseconds. */
+    void released( double held );
+
+    /**
+     * Returns the thread holding the lock now or 0.
+     *
+     * The thread is remembered between the <i>acquired</i>
+     * and the <i>released</i> calls.
+     */
+
+    TID holder() const { return m_holder; }
+
+  private:
+
+    /** Constructs the statistics of the named lock. */
+    PMLockProfile( const char* name );
+
+    /** Writes the statistics of the lock. */
+    void report_lock( FILE* file );
+
+    const char*    m_name;
+    ULONG          m_acquired;
+    ULONG          m_contended;
+    double         m_total_wait;
+    double         m_max_wait;
+    ULONG          m_long_waits;
+    TID            m_owner;
+    volatile TID   m_holder;
+    ULONG          m_released;
+    double         m_max_hold;
+    ULONG          m_hold[32];
+    PMFastMutex    m_mutex;
+    PMLockProfile* m_next;
+
+    static volatile BOOL  m_enabled;
+    static PMLockProfile* m_locks;
+};
+
+/**
+ * Locks a resource and profiles the lock.
+ *
+ * The PMProfiledLock class locks a resource like the PMLock class
+ * and, while the lock profiling is enabled by the PMLockProfile class,
+ * accounts the wait and the hold time of the resource under the
+ * specified name. It is intended for the resources that don't profile
+ * themselves, such as PMFastMutex. The thread holding the resource while
+ * another thread waits for it longer than PM_LOCKPROF_LONG_WAIT is known
+ * only if all locks of the resource are profiled.
+ *
+ * A named PMMutex profiles itself and must be locked by the PMLock
+ * class, a profiled lock would account each acquisition twice.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+template <class T> class PMProfiledLock : public PMNonCopyable
+{
+  public:
+
+    /**
+     * Constructs the lock and request access to resource.
+     *
+     * Request access to resource. Blocks the calling thread
+     * indefinitely.
+     *
+     * @param name  The name under which the lock is profiled.
+     */
+
+    PMProfiledLock( T& res, const char* name ) : m_res( res ), m_profile( NULL )
+    {
+      if( PMLockProfile::enabled()) {
+        double start;
+        double waited;
+        TID    owner;
+
+        m_profile = PMLockProfile::find( name );
+        owner = m_profile->holder();
+        start = PMLockProfile::now();
+        m_res.request();
+        m_acquired_at = PMLockProfile::now();
+        waited = m_acquired_at - start;
+        m_profile->acquired( waited, waited >= PM_LOCKPROF_CONTENDED, owner );
+      } else {
+        m_res.request();
+      }
+    }
+
+    /**
+     * Destroys the lock and relinquishes ownership of a resource.
+     *
+     * Relinquishes ownership of a resource that was requested by
+     * constructor.
+     */
+
+   ~PMProfiledLock() {
+      if( m_profile ) {
+        m_profile->released( PMLockProfile::now() - m_acquired_at );
+      }
+      m_res.release();
+    }
+
+  private:
+    T&             m_res;
+    PMLockProfile* m_profile;
+    double         m_acquired_at;
+};
+
+#endif
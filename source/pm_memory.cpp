@@ -7,6 +7,8 @@
 #include "pm_error.h"
 #include "pm_debuglog.h"
 #include "pm_memory.h"
+#include "pm_gui.h"
+#include "pm_smp.h"
 
 #if defined(DEBUG) && DEBUG >= 2
 
@@ -35,11 +37,261 @@
     DEBUGLOG(( "%s free %d bytes at %08X, remain %u blocks, %u bytes, %u max used\n",     \
                __FUNCTION__, _msize(p), p, blocks, used, used_max ));                     \
   }
+
+  // The statistics know only the blocks of the C runtime.
+  #undef  PM_MEMORY_POOL
+  #define PM_MEMORY_POOL 0
 #else
   #define DEBUG_MALLOC( p )
   #define DEBUG_FREE( p )
 #endif
 
+#if PM_MEMORY_POOL
+
+#define POOL_CLASSES    12
+#define POOL_MAX_SIZE   256
+#define POOL_CHUNK_SIZE 65536UL
+#define POOL_BATCH      ( PM_MEMORY_CACHE_SIZE / 2 )
+
+static const ULONG class_size[POOL_CLASSES] = {
+  8, 16, 24, 32, 48, 64, 80, 96, 128, 160, 192, 256
+};
+
+// The size class of the blocks by their size in 8 byte units.
+static const unsigned char size_class[POOL_MAX_SIZE/8+1] = {
+  0, 0, 1, 2, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 8, 8,
+  9, 9, 9, 9, 10, 10, 10, 10, 11, 11, 11, 11, 11, 11, 11, 11
+};
+
+struct QClass {
+  void*          m_free;
+  volatile ULONG m_mutex;
+};
+
+struct QCache {
+  void*          m_free [POOL_CLASSES];
+  ULONG          m_count[POOL_CLASSES];
+};
+
+static QClass classes[POOL_CLASSES];
+static QCache caches [PM_MAX_THREADS];
+
+// The DosAllocMem places the memory objects at the 64K boundaries.
+// Each byte of the map keeps the size class of one of the memory
+// objects taken by the pools plus one or zero for other memory.
+static unsigned char chunk_map[ 65536 ];
+
+/* Returns the size class of the pool block plus one
+ * or zero for the block of the C runtime.
+ */
+
+static inline ULONG pool_of( void* p )
+{
+  ULONG chunk = (ULONG)p / POOL_CHUNK_SIZE;
+  return chunk < sizeof( chunk_map ) ? chunk_map[ chunk ] : 0;
+}
+
+#if defined(__WATCOMC__)
+
+// The FS selector addresses the TIB of the current thread. Its fourth
+// field points to the TIB2 which starts with the thread identifier.
+extern ULONG current_tid( void );
+#pragma aux current_tid = "mov eax,fs:[0Ch]" "mov eax,[eax]" value [EAX];
+
+#else
+
+/* Returns the identifier of the calling thread.
+ */
+
+static inline ULONG current_tid()
+{
+  PTIB ptib;
+  DosGetInfoBlocks( &ptib, NULL );
+  return ptib->tib_ptib2->tib2_ultid;
+}
+
+#endif
+
+/* Returns the cache of the calling thread or NULL.
+ *
+ * Is called once by each allocation function, the cache
+ * is passed to the pool functions.
+ */
+
+static inline QCache* thread_cache()
+{
+  ULONG tid = current_tid();
+
+  // A new thread takes over the cache left by the finished
+  // thread having the same identifier.
+  if( tid < PM_MAX_THREADS ) {
+    return &caches[ tid ];
+  } else {
+    return NULL;
+  }
+}
+
+/* Requests the shared pool of the size class.
+ */
+
+static void pool_lock( QClass* pool )
+{
+  ULONG count = 0;
+
+  while( xchg((ULONG&)pool->m_mutex, 1UL )) {
+    spin_yield( count );
+  }
+}
+
+/* Releases the shared pool of the size class.
+ */
+
+static void pool_unlock( QClass* pool ) {
+  xchg((ULONG&)pool->m_mutex, 0UL );
+}
+
+/* Splits a new memory object into the blocks of the size class.
+ *
+ * Must be called with the shared pool requested.
+ */
+
+static BOOL pool_grow( ULONG cls )
+{
+  ULONG size = class_size[cls];
+  char* chunk;
+  ULONG i;
+
+  if( DosAllocMem((PPVOID)&chunk, POOL_CHUNK_SIZE, PAG_READ | PAG_WRITE | PAG_COMMIT ) != NO_ERROR ) {
+    return FALSE;
+  }
+
+  chunk_map[(ULONG)chunk / POOL_CHUNK_SIZE ] = (unsigned char)( cls + 1 );
+
+  for( i = POOL_CHUNK_SIZE / size; i--; ) {
+    *(void**)( chunk + i * size ) = classes[cls].m_free;
+    classes[cls].m_free = chunk + i * size;
+  }
+
+  return TRUE;
+}
+
+/* Allocates a block of the size class or returns NULL.
+ */
+
+static void* pool_alloc( ULONG cls, QCache* cache )
+{
+  QClass* pool = &classes[cls];
+  void*   p;
+
+  if( cache && cache->m_free[cls] ) {
+    p = cache->m_free[cls];
+    cache->m_free[cls] = *(void**)p;
+    cache->m_count[cls]--;
+    return p;
+  }
+
+  pool_lock( pool );
+
+  if( !pool->m_free && !pool_grow( cls )) {
+    pool_unlock( pool );
+    return NULL;
+  }
+
+  p = pool->m_free;
+  pool->m_free = *(void**)p;
+
+  // Moves a batch of the blocks into the empty cache.
+  if( cache ) {
+    while( pool->m_free && cache->m_count[cls] < POOL_BATCH ) {
+      void* next = *(void**)pool->m_free;
+      *(void**)pool->m_free = cache->m_free[cls];
+      cache->m_free[cls] = pool->m_free;
+      cache->m_count[cls]++;
+      pool->m_free = next;
+    }
+  }
+
+  pool_unlock( pool );
+  return p;
+}
+
+/* Frees a block of the size class.
+ */
+
+static void pool_free( void* p, ULONG cls, QCache* cache )
+{
+  QClass* pool = &classes[cls];
+  void*   last = p;
+  ULONG   i;
+
+  if( cache ) {
+    *(void**)p = cache->m_free[cls];
+    cache->m_free[cls] = p;
+
+    if( ++cache->m_count[cls] <= PM_MEMORY_CACHE_SIZE ) {
+      return;
+    }
+
+    // Returns a half of the full cache to the shared pool.
+    for( i = 1; i < POOL_BATCH; i++ ) {
+      last = *(void**)last;
+    }
+
+    cache->m_free[cls] = *(void**)last;
+    cache->m_count[cls] -= POOL_BATCH;
+
+    pool_lock( pool );
+    *(void**)last = pool->m_free;
+    pool->m_free  = p;
+    pool_unlock( pool );
+  } else {
+    pool_lock( pool );
+    *(void**)p   = pool->m_free;
+    pool->m_free = p;
+    pool_unlock( pool );
+  }
+}
+
+#endif
+
+/* Allocates a block or returns NULL.
+ */
+
+static inline void* allocate( size_t size )
+{
+  void* p;
+
+  #if PM_MEMORY_POOL
+  if( size && size <= POOL_MAX_SIZE ) {
+    if(( p = pool_alloc( size_class[( size + 7 ) / 8 ], thread_cache())) != NULL ) {
+      return p;
+    }
+  }
+  #endif
+
+  p = malloc( size );
+  DEBUG_MALLOC( p );
+  return p;
+}
+
+/* Frees a block allocated by the pools or by the C runtime.
+ */
+
+static inline void release( void* p )
+{
+  #if PM_MEMORY_POOL
+  ULONG pool = pool_of( p );
+
+  if( pool ) {
+    pool_free( p, pool - 1, thread_cache());
+    return;
+  }
+  #endif
+
+  DEBUG_FREE( p );
+  free( p );
+}
+
 /* Reserves a block of storage of size bytes.
  *
  * Returns a pointer to the reserved space. The storage space to which
@@ -49,13 +301,12 @@
 
 void* xmalloc( size_t size )
 {
-  void* p = malloc( size );
+  void* p = allocate( size );
 
   if( !p && size ) {
     PM_THROW_ERROR( ENOMEM, "CLIB", strerror( ENOMEM ));
   }
 
-  DEBUG_MALLOC( p );
   return p;
 }
 
@@ -68,6 +319,42 @@ void* xmalloc( size_t size )
 
 void* xrealloc( void* p, size_t size )
 {
+  #if PM_MEMORY_POOL
+  ULONG pool = pool_of( p );
+
+  // The pool blocks are moved by hand, the blocks of
+  // the C runtime are reallocated by the C runtime.
+  if( pool || !p )
+  {
+    ULONG   capacity = pool ? class_size[ pool - 1 ] : 0;
+    QCache* cache;
+    void*   moved = NULL;
+
+    if( !size ) {
+      xfree( p );
+      return NULL;
+    }
+    if( size <= capacity ) {
+      return p;
+    }
+
+    cache = thread_cache();
+
+    if( size <= POOL_MAX_SIZE ) {
+      moved = pool_alloc( size_class[( size + 7 ) / 8 ], cache );
+    }
+    if( !moved && ( moved = malloc( size )) == NULL ) {
+      PM_THROW_ERROR( ENOMEM, "CLIB", strerror( ENOMEM ));
+    }
+    if( p ) {
+      memcpy( moved, p, capacity );
+      pool_free( p, pool - 1, cache );
+    }
+
+    return moved;
+  }
+  #endif
+
   DEBUG_FREE( p );
   p = realloc( p, size );
 
@@ -95,7 +382,18 @@ void* xrealloc( void* p, size_t size )
 
 void* xcalloc( size_t num, size_t size )
 {
-  void* p = calloc( num, size );
+  void* p;
+
+  #if PM_MEMORY_POOL
+  if( num && size && num <= POOL_MAX_SIZE / size ) {
+    if(( p = allocate( num * size )) == NULL ) {
+      PM_THROW_ERROR( ENOMEM, "CLIB", strerror( ENOMEM ));
+    }
+    return memset( p, 0, num * size );
+  }
+  #endif
+
+  p = calloc( num, size );
 
   if( !p && size && num ) {
     PM_THROW_ERROR( ENOMEM, "CLIB", strerror( ENOMEM ));
@@ -115,8 +413,7 @@ void* xcalloc( size_t num, size_t size )
 void xfree( void *p )
 {
   if( p ) {
-    DEBUG_FREE( p );
-    free( p );
+    release( p );
   }
 }
 
@@ -133,13 +430,12 @@ char* xstrdup( const char* string )
 {
   if( string ) {
     size_t size = strlen( string ) + 1;
-    char*  p = (char*)malloc( size );
+    char*  p = (char*)allocate( size );
 
     if( !p ) {
       PM_THROW_ERROR( ENOMEM, "CLIB", strerror( ENOMEM ));
     }
 
-    DEBUG_MALLOC( p );
     return (char*)memcpy( p, string, size );
   } else {
     return NULL;
@@ -153,13 +449,12 @@ char* xstrdup( const char* string )
 
 void* operator new( size_t size )
 {
-  void* p = malloc( size );
+  void* p = allocate( size );
 
   if( !p ) {
     PM_THROW_ERROR( ENOMEM, "CLIB", strerror( ENOMEM ));
   }
 
-  DEBUG_MALLOC( p );
   return p;
 }
 
@@ -175,8 +470,7 @@ void* operator new[]( size_t size ) {
 void operator delete( void *p )
 {
   if( p ) {
-    DEBUG_FREE( p );
-    free( p );
+    release( p );
   }
 }
 
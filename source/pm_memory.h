@@ -8,6 +8,39 @@
 #include "pm_os2.h"
 #include <stdlib.h>
 
+#ifndef PM_MEMORY_POOL
+
+/**
+ * Selects the allocator of the small blocks at build time.
+ *
+ * If it is nonzero, the blocks up to 256 bytes requested by the
+ * memory allocation functions and by the global operator new are taken
+ * from the size class pools with the per-thread caches. If it is zero,
+ * all blocks are allocated by the C runtime. The pools are always
+ * disabled in the debug builds with DEBUG >= 2, which account
+ * the blocks by the C runtime.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_MEMORY_POOL 1
+#endif
+
+#ifndef PM_MEMORY_CACHE_SIZE
+
+/**
+ * Sets the maximum number of the free blocks of one size class
+ * kept by each thread. When the cache is full, half of the blocks
+ * are returned to the shared pool. Must be at least 2.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_MEMORY_CACHE_SIZE 64
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -25,6 +58,16 @@ extern "C" {
  * not need to check for  a  NULL return value,  and  the code that
  * calls these functions is simpler due to the lack of error checks.
  *
+ * The small blocks are allocated from the size class pools. Each
+ * pool takes 64K memory objects from the system and splits them into
+ * the blocks of the same size, which are reused after they are freed,
+ * but are never returned to the system. Each thread keeps a few free
+ * blocks of each size, so most allocations don't need any locks. The
+ * larger blocks are allocated by the C runtime. The <i>xfree</i> and
+ * <i>xrealloc</i> functions also accept the blocks allocated by
+ * <i>malloc</i>, but the blocks returned by these functions
+ * must not be freed by <i>free</i>.
+ *
  * @pkgdoc Memory_Functions
  */
 
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#include "pm_mpscqueue.h"
+#include "pm_memory.h"
+#include "pm_smp.h"
+
+/* Creates a queue object.
+ */
+
+PMMpscQueue::PMMpscQueue()
+
+: m_posted   ( NULL ),
+  m_frst_node( NULL ),
+  m_last_node( NULL )
+{}
+
+/* Destroys the queue object.
+ */
+
+PMMpscQueue::~PMMpscQueue() {
+  clear();
+}
+
+/* Sorts the list by priorities keeping the order of equal elements.
+ */
+
+PMMpscQueue::QNode* PMMpscQueue::sort( QNode* list )
+{
+  QNode*  half;
+  QNode*  fast;
+  QNode*  merged = NULL;
+  QNode** tail   = &merged;
+
+  // The lists already ordered, usually having the same
+  // priority, are detected by one pass.
+  for( fast = list; fast && fast->m_next_node; fast = fast->m_next_node ) {
+    if( fast->m_next_node->m_priority > fast->m_priority ) {
+      break;
+    }
+  }
+
+  if( !fast || !fast->m_next_node ) {
+    return list;
+  }
+
+  for( half = list, fast = list->m_next_node; fast && fast->m_next_node; ) {
+    half = half->m_next_node;
+    fast = fast->m_next_node->m_next_node;
+  }
+
+  fast = half->m_next_node;
+  half->m_next_node = NULL;
+  half = sort( list );
+  fast = sort( fast );
+
+  while( half && fast ) {
+    if( half->m_priority >= fast->m_priority ) {
+      *tail = half;
+      half  = half->m_next_node;
+    } else {
+      *tail = fast;
+      fast  = fast->m_next_node;
+    }
+    tail = &(*tail)->m_next_node;
+  }
+
+  *tail = half ? half : fast;
+  return merged;
+}
+
+/* Moves the posted elements into the consumer's list.
+ */
+
+BOOL PMMpscQueue::collect()
+{
+  QNode*  posted  = xchg( (QNode*&)m_posted, (QNode*)NULL );
+  QNode*  ordered = NULL;
+  QNode*  node;
+  QNode** link;
+
+  if( !posted ) {
+    return m_frst_node != NULL;
+  }
+
+  // The posted elements are stacked in the reverse order.
+  while( posted ) {
+    node = posted;
+    posted = node->m_next_node;
+    node->m_next_node = ordered;
+    ordered = node;
+  }
+
+  // The batch is sorted as a whole and is merged into the consumer's
+  // list by one pass. The earlier elements go first if the priorities
+  // are equal.
+  ordered = sort( ordered );
+
+  if( m_last_node && m_last_node->m_priority >= ordered->m_priority ) {
+    m_last_node->m_next_node = ordered;
+  } else {
+    for( link = &m_frst_node; *link && ordered; link = &(*link)->m_next_node ) {
+      if( (*link)->m_priority < ordered->m_priority ) {
+        node = ordered;
+        ordered = node->m_next_node;
+        node->m_next_node = *link;
+        *link = node;
+      }
+    }
+    if( ordered ) {
+      *link = ordered;
+    }
+  }
+
+  for( node = m_last_node ? m_last_node : m_frst_node; node->m_next_node; ) {
+    node = node->m_next_node;
+  }
+
+  m_last_node = node;
+  return TRUE;
+}
+
+/* Purges a queue of all its elements.
+ */
+
+void PMMpscQueue::clear()
+{
+  QNode* node;
+  QNode* next;
+
+  collect();
+
+  for( node = m_frst_node; node; node = next ) {
+    next = node->m_next_node;
+    xfree( node );
+  }
+
+  m_frst_node = NULL;
+  m_last_node = NULL;
+}
+
+/* Is a queue empty.
+ */
+
+BOOL PMMpscQueue::empty() const {
+  return !m_frst_node && !m_posted;
+}
+
+/* Reads an element from a queue.
+ */
+
+BOOL PMMpscQueue::read( ULONG* request, void** data, ULONG* priority )
+{
+  QNode* node;
+
+  // The notify is reset before the posted list is examined, therefore
+  // a write made after the examination can not be missed.
+  while( !m_frst_node && !collect()) {
+    m_data_ready.wait();
+    m_data_ready.reset();
+  }
+
+  node = m_frst_node;
+
+  if( request  ) { *request  = node->m_request;  }
+  if( data     ) { *data     = node->m_data;     }
+  if( priority ) { *priority = node->m_priority; }
+
+  if(( m_frst_node = node->m_next_node ) == NULL ) {
+    m_last_node = NULL;
+  }
+
+  xfree( node );
+  return TRUE;
+}
+
+/* Examines a queue element without removing
+ * it from the queue.
+ */
+
+BOOL PMMpscQueue::peek( ULONG* request, void** data, ULONG* priority )
+{
+  if( m_posted ) {
+    collect();
+  }
+
+  if( m_frst_node )
+  {
+    if( request  ) { *request  = m_frst_node->m_request;  }
+    if( data     ) { *data     = m_frst_node->m_data;     }
+    if( priority ) { *priority = m_frst_node->m_priority; }
+
+    return TRUE;
+  } else {
+    return FALSE;
+  }
+}
+
+/* Examines a queue element without removing
+ * it from the queue.
+ */
+
+BOOL PMMpscQueue::peek( ULONG first, ULONG last )
+{
+  if( m_posted ) {
+    collect();
+  }
+
+  return m_frst_node &&
+         m_frst_node->m_request >= first &&
+         m_frst_node->m_request <= last;
+}
+
+/* Adds an element to a queue.
+ */
+
+void PMMpscQueue::write( ULONG request, void* data, ULONG priority )
+{
+  QNode* node = (QNode*)xmalloc( sizeof( QNode ));
+  QNode* head;
+
+  node->m_request  = request;
+  node->m_data     = data;
+  node->m_priority = priority;
+
+  do {
+    head = m_posted;
+    node->m_next_node = head;
+  } while( cmpxchg( (QNode*&)m_posted, node, head ) != head );
+
+  // Only the producer that makes the posted list non-empty
+  // must notify the consumer.
+  if( !head ) {
+    m_data_ready.post();
+  }
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_MPSCQUEUE_H
+#define PM_MPSCQUEUE_H
+
+#include <stdlib.h>
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_notify.h"
+
+/**
+ * Multiple producers single consumer queue class.
+ *
+ * This queue is intended to pass information from many threads to
+ * one consumer thread. Unlike PMQueue it does not use a mutex
+ * semaphore: the producers push the new elements onto a list by
+ * an atomic compare and exchange operation and the consumer takes
+ * away the whole list by an atomic exchange. The consumer thread is
+ * notified only when the list becomes non-empty, so most of writes
+ * do not make any system call.
+ *
+ * The elements are read in the order of their priorities. Elements
+ * having the same priority are read in the order in which they were
+ * written by the same thread.
+ *
+ * Methods <i>write</i> can be called from any thread. Methods <i>read</i>,
+ * <i>peek</i> and <i>clear</i> must be called from one consumer
+ * thread only.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+class PMMpscQueue : public PMNonCopyable
+{
+  public:
+
+    /** Creates a queue object. */
+    PMMpscQueue();
+    /** Destroys the queue object. */
+   ~PMMpscQueue();
+
+    /** Purges a queue of all its elements. */
+    void clear();
+    /** Is a queue empty. */
+    BOOL empty() const;
+
+    /**
+     * Reads an element from a queue.
+     *
+     * @param request   An event code that is specified by the application.
+     * @param data      A pointer to the data that is being removed.
+     * @param priority  The address of the element's priority.
+     */
+
+    BOOL read( ULONG* request, void** data = NULL, ULONG* priority = NULL );
+
+    /**
+     * Examines a queue element without removing it from the queue.
+     *
+     * @param request   An event code that is specified by the application.
+     * @param data      A pointer to the examined data.
+     * @param priority  The address of the element's priority.
+     */
+
+    BOOL peek( ULONG* request, void** data = NULL, ULONG* priority = NULL );
+
+    /**
+     * Examines a queue element without removing it from the queue.
+     *
+     * @param first     First event code.
+     * @param last      Last event code.
+     *
+     * @return TRUE if a next queue element has a event code in range specified
+     *              by the <i>first</i> and <i>last</i> inclusive.
+     */
+
+    BOOL peek( ULONG first, ULONG last );
+
+    /**
+     * Adds an element to a queue.
+     *
+     * @param request   An event code that is specified by the application.
+     * @param data      A data to be placed into the queue.
+     * @param priority  The priority value of the element that is being added to the queue.
+     */
+
+    void write( ULONG request, void* data = NULL, ULONG priority = 0 );
+
+  private:
+
+    struct QNode {
+      ULONG  m_request;
+      void*  m_data;
+      ULONG  m_priority;
+      QNode* m_next_node;
+    };
+
+    QNode* volatile m_posted;
+    QNode*   m_frst_node;
+    QNode*   m_last_node;
+    PMNotify m_data_ready;
+
+    /**
+     * Moves the posted elements into the consumer's list.
+     * @return TRUE if the consumer's list is not empty.
+     */
+
+    BOOL collect();
+
+    /** Sorts the list by priorities keeping the order of equal elements. */
+    static QNode* sort( QNode* list );
+};
+
+#endif
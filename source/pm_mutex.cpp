@@ -7,7 +7,13 @@
 /* Constructs the mutual exclusion object.
  */
 
-PMMutex::PMMutex() {
+PMMutex::PMMutex( const char* name )
+
+: m_name       ( name ),
+  m_profile    ( NULL ),
+  m_depth      ( 0    ),
+  m_acquired_at( 0    )
+{
   DosCreateMutexSem( NULL, &m_handle, 0, 0 );
 }
 
@@ -24,7 +30,12 @@ PMMutex::~PMMutex() {
  * Blocks the calling thread indefinitely.
  */
 
-BOOL PMMutex::request() {
+BOOL PMMutex::request()
+{
+  if( PMLockProfile::enabled()) {
+    return profiled_request( SEM_INDEFINITE_WAIT );
+  }
+
   return !WinRequestMutexSem( m_handle, SEM_INDEFINITE_WAIT );
 }
 
@@ -34,7 +45,12 @@ BOOL PMMutex::request() {
  * Blocks the calling thread.
  */
 
-BOOL PMMutex::request( unsigned long mseq ) {
+BOOL PMMutex::request( unsigned long mseq )
+{
+  if( PMLockProfile::enabled()) {
+    return profiled_request( mseq );
+  }
+
   return !WinRequestMutexSem( m_handle, mseq );
 }
 
@@ -44,6 +60,66 @@ BOOL PMMutex::request( unsigned long mseq ) {
  * Only the thread that owns the resource can issue release().
  */
 
-BOOL PMMutex::release() {
+BOOL PMMutex::release()
+{
+  if( m_depth ) {
+    return profiled_release();
+  }
+
+  return !DosReleaseMutexSem( m_handle );
+}
+
+/* Requests access to resource and accounts the contention.
+ */
+
+BOOL PMMutex::profiled_request( unsigned long msec )
+{
+  BOOL   contended = FALSE;
+  double waited    = 0;
+  TID    owner     = 0;
+  PID    pid;
+  ULONG  count;
+  APIRET rc;
+
+  if( !m_profile ) {
+    m_profile = PMLockProfile::find( m_name );
+  }
+
+  if(( rc = DosRequestMutexSem( m_handle, SEM_IMMEDIATE_RETURN )) == ERROR_TIMEOUT )
+  {
+    double start = PMLockProfile::now();
+
+    // The owner can release the mutex before it is queried.
+    if( DosQueryMutexSem( m_handle, &pid, &owner, &count ) != NO_ERROR ) {
+      owner = 0;
+    }
+
+    contended = TRUE;
+    rc = WinRequestMutexSem( m_handle, msec );
+    waited = PMLockProfile::now() - start;
+  }
+
+  if( rc != NO_ERROR ) {
+    return FALSE;
+  }
+
+  // The nested requests of the owner are not accounted.
+  if( ++m_depth == 1 ) {
+    m_profile->acquired( waited, contended, owner );
+    m_acquired_at = PMLockProfile::now();
+  }
+
+  return TRUE;
+}
+
+/* Relinquishes ownership of a resource and accounts the hold time.
+ */
+
+BOOL PMMutex::profiled_release()
+{
+  if( --m_depth == 0 ) {
+    m_profile->released( PMLockProfile::now() - m_acquired_at );
+  }
+
   return !DosReleaseMutexSem( m_handle );
 }
@@ -7,6 +7,7 @@
 
 #include "pm_os2.h"
 #include "pm_noncopyable.h"
+#include "pm_lockprof.h"
 
 /**
  * Serialize access to resources.
@@ -16,6 +17,9 @@
  * simultaneous access by several processes. Class also enable threads
  * to serialize their access to resources.
  *
+ * While the lock profiling is enabled by the PMLockProfile class,
+ * the contention of the mutex is accounted under its name.
+ *
  * None of the functions in this class throws exceptions because
  * an exception probably has been thrown already or is about
  * to be thrown.
@@ -29,8 +33,14 @@
 class PMMutex : public PMNonCopyable
 {
   public:
-    /** Constructs the mutual exclusion object. */
-    PMMutex();
+    /**
+     * Constructs the mutual exclusion object.
+     *
+     * @param name  The name under which the contention of the mutex
+     *              is profiled. It must stay valid while the program runs.
+     */
+
+    PMMutex( const char* name = NULL );
     /** Destructs  the mutual exclusion object. */
    ~PMMutex();
 
@@ -72,7 +82,16 @@ class PMMutex : public PMNonCopyable
 
   private:
 
-    HMTX m_handle;
+    HMTX           m_handle;
+    const char*    m_name;
+    PMLockProfile* m_profile;
+    ULONG          m_depth;
+    double         m_acquired_at;
+
+    /** Requests access to resource and accounts the contention. */
+    BOOL profiled_request( unsigned long msec );
+    /** Relinquishes ownership of a resource and accounts the hold time. */
+    BOOL profiled_release();
 };
 
 #endif
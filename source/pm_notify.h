@@ -79,6 +79,9 @@ class PMNotify : public PMNonCopyable
 
     BOOL reset();
 
+    /** Returns the handle of the event semaphore. */
+    HEV handle() const { return m_handle; }
+
   private:
 
     HEV m_handle;
@@ -33,6 +33,14 @@
 #define PM_SETTEXT        (PM_BASE+7) /* Sets a window text.                         */
 #define PM_QUERYOBJECT    (PM_BASE+8) /* Queries a window object.                    */
 #define PM_ALIGN          (PM_BASE+9) /* Sets aligment for window.                   */
+#define PM_TASK_END       (PM_BASE+10)/* Notify the submitting thread about the      */
+                                      /* completion of the thread pool task.         */
+
+/* Missing in the older toolkits */
+
+#ifndef QSV_NUMPROCESSORS
+#define QSV_NUMPROCESSORS 26
+#endif
 
 /* Additional dialog codes: returned by WM_QUERYDLGCODE message */
 
@@ -66,5 +74,6 @@
 
 #define PM_WINDOW "PMWindow"
 #define PM_SLIDER "PMSlider"
+#define PM_TASKWINDOW "PMTaskWindow"
 
 #endif
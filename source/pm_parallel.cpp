@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#include "pm_parallel.h"
+#include "pm_fastmutex.h"
+#include "pm_lock.h"
+
+// The job is closed when the calling thread has exhausted
+// the range. The lower bits count the running helpers.
+#define PM_PARALLEL_CLOSED 0x80000000UL
+
+static PMFastMutex   pool_mutex;
+static PMThreadPool* volatile pool_instance = NULL;
+static volatile BOOL pool_created = FALSE;
+
+/* Returns the internal thread pool or NULL on a uniprocessor system.
+ */
+
+PMThreadPool* PMParallel::pool()
+{
+  if( !pool_created )
+  {
+    PMLock<PMFastMutex> lock( pool_mutex );
+
+    if( !pool_created )
+    {
+      ULONG processors = PMGUI::processors();
+
+      if( processors > 1 ) {
+        // The calling thread does its share of work too. The pool
+        // lives until the end of the process.
+        pool_instance = new PMThreadPool( processors - 1 );
+      }
+
+      pool_created = TRUE;
+    }
+  }
+
+  return pool_instance;
+}
+
+/* Returns the number of threads executing the loops.
+ */
+
+ULONG PMParallel::threads()
+{
+  PMThreadPool* workers = pool();
+  return workers ? workers->threads() + 1 : 1;
+}
+
+/* Returns the grain size used for the specified number of indices.
+ */
+
+ULONG PMParallel::grain( ULONG count, ULONG grain )
+{
+  if( !grain ) {
+    grain = count / ( threads() * PM_PARALLEL_CHUNKS );
+  }
+
+  return grain ? grain : 1;
+}
+
+/* Executes the chunks of the job until the range is exhausted.
+ */
+
+void PMParallel::work( QJob* job )
+{
+  ULONG first;
+
+  while(( first = job->m_next.fetch_add( job->m_grain )) < job->m_last ) {
+    ULONG last = job->m_last - first > job->m_grain ? first + job->m_grain : job->m_last;
+    job->m_fn( first, last, job->m_arg );
+  }
+}
+
+/* Releases a reference to the job.
+ */
+
+void PMParallel::release( QJob* job )
+{
+  if( job->m_refs.fetch_sub( 1, PM_ACQ_REL ) == 1 ) {
+    delete job;
+  }
+}
+
+/* Helper task executing the chunks of the job.
+ */
+
+void PMParallel::help( void* arg )
+{
+  QJob* job   = (QJob*)arg;
+  ULONG state = job->m_state.load( PM_RELAXED );
+
+  // The helper started after the calling thread has exhausted
+  // the range must not touch the arguments of the job anymore.
+  do {
+    if( state & PM_PARALLEL_CLOSED ) {
+      release( job );
+      return;
+    }
+  } while( !job->m_state.compare_exchange( state, state + 1 ));
+
+  work( job );
+
+  if( job->m_state.fetch_sub( 1 ) == ( PM_PARALLEL_CLOSED | 1 )) {
+    job->m_done.post();
+  }
+
+  release( job );
+}
+
+/* Executes the body function over the range of indices.
+ */
+
+void PMParallel::run( ULONG first, ULONG last, ULONG grain, body fn, void* arg )
+{
+  if( first >= last ) {
+    return;
+  }
+
+  PMThreadPool* workers = pool();
+  ULONG chunks;
+  ULONG helpers;
+  ULONG state;
+  ULONG i;
+
+  grain  = PMParallel::grain( last - first, grain );
+  chunks = ( last - first - 1 ) / grain + 1;
+
+  if( !workers || chunks == 1 ) {
+    for( ; last - first > grain; first += grain ) {
+      fn( first, first + grain, arg );
+    }
+    fn( first, last, arg );
+    return;
+  }
+
+  helpers = chunks - 1 < workers->threads() ? chunks - 1 : workers->threads();
+
+  QJob* job = new QJob;
+
+  job->m_next .store( first,       PM_RELAXED );
+  job->m_state.store( 0,           PM_RELAXED );
+  job->m_refs .store( helpers + 1, PM_RELAXED );
+  job->m_last  = last;
+  job->m_grain = grain;
+  job->m_fn    = fn;
+  job->m_arg   = arg;
+
+  for( i = 0; i < helpers; i++ ) {
+    workers->submit( help, job );
+  }
+
+  work( job );
+
+  // Closes the job and waits only for the helpers
+  // which are executing its chunks now.
+  state = job->m_state.load( PM_RELAXED );
+  while( !job->m_state.compare_exchange( state, state | PM_PARALLEL_CLOSED ))
+  {}
+
+  if( state ) {
+    job->m_done.wait();
+  }
+
+  release( job );
+}
@@ -0,0 +1,495 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_PARALLEL_H
+#define PM_PARALLEL_H
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_threadpool.h"
+#include "pm_notify.h"
+#include "pm_atomic.h"
+
+#ifndef PM_PARALLEL_CHUNKS
+
+/**
+ * Sets the number of chunks per thread the work is split into
+ * when the grain size isn't specified. The more chunks are used,
+ * the better the load is balanced between the threads and the more
+ * the overhead is.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_PARALLEL_CHUNKS 4
+#endif
+
+#ifndef PM_PARALLEL_SORT_GRAIN
+
+/**
+ * Sets the minimum number of elements sorted or merged by
+ * one thread at a time by the <i>parallel_sort</i> function.
+ * The smaller arrays are sorted by the calling thread alone.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_PARALLEL_SORT_GRAIN 1024
+#endif
+
+/**
+ * Parallel loops.
+ *
+ * The PMParallel class splits a range of indices into chunks
+ * and executes the chunks by the calling thread and by the worker
+ * threads of the internal thread pool. The pool has one worker thread
+ * per processor and is started by the first call. On a uniprocessor
+ * system or if the range is not larger than one chunk, all work is
+ * done by the calling thread.
+ *
+ * The calling thread executes the chunks itself until the range
+ * is exhausted and then waits only for the chunks being executed by
+ * other threads, so the loops can be nested and can be started from
+ * the tasks of any thread pool.
+ *
+ * The body functions must not throw exceptions.
+ *
+ * You can't construct objects of this class, use its static methods
+ * or the <i>parallel_for</i>, <i>parallel_transform</i>,
+ * <i>parallel_reduce</i> and <i>parallel_sort</i> functions.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+class PMParallel : public PMNonCopyable
+{
+  public:
+
+    /** Body function executing the indices from first to last exclusive. */
+    typedef void (*body)( ULONG first, ULONG last, void* arg );
+
+    /**
+     * Executes the body function over the range of indices.
+     *
+     * @param first  The first index.
+     * @param last   The index following the last one.
+     * @param grain  The number of indices executed by a thread
+     *               at a time or zero to choose it automatically.
+     * @param fn     The body function.
+     * @param arg    The argument passed to the body function.
+     */
+
+    static void run( ULONG first, ULONG last, ULONG grain, body fn, void* arg );
+
+    /**
+     * Returns the grain size used for the specified number
+     * of indices if the grain size is zero.
+     */
+
+    static ULONG grain( ULONG count, ULONG grain = 0 );
+
+    /** Returns the number of threads executing the loops. */
+    static ULONG threads();
+
+  private:
+
+    struct QJob {
+      PMAtomic<ULONG> m_next;
+      PMAtomic<ULONG> m_state;
+      PMAtomic<ULONG> m_refs;
+      ULONG           m_last;
+      ULONG           m_grain;
+      body            m_fn;
+      void*           m_arg;
+      PMNotify        m_done;
+    };
+
+    /** Returns the internal thread pool or NULL on a uniprocessor system. */
+    static PMThreadPool* pool();
+    /** Executes the chunks of the job until the range is exhausted. */
+    static void work( QJob* job );
+    /** Helper task executing the chunks of the job. */
+    static void help( void* job );
+    /** Releases a reference to the job. */
+    static void release( QJob* job );
+};
+
+/**
+ * Loop body adapters.
+ *
+ * Used by the parallel algorithms to pass the function
+ * objects to the PMParallel::run method.
+ */
+
+template <class F> struct PMParallelFor
+{
+  F& m_fn;
+
+  PMParallelFor( F& fn ) : m_fn( fn ) {}
+
+  static void body( ULONG first, ULONG last, void* arg )
+  {
+    PMParallelFor<F>* self = (PMParallelFor<F>*)arg;
+
+    for( ; first < last; first++ ) {
+      self->m_fn( first );
+    }
+  }
+};
+
+template <class T, class U, class F> struct PMParallelTransform
+{
+  const T* m_in;
+  U*       m_out;
+  F&       m_fn;
+
+  PMParallelTransform( const T* in, U* out, F& fn ) : m_in( in ), m_out( out ), m_fn( fn ) {}
+
+  static void body( ULONG first, ULONG last, void* arg )
+  {
+    PMParallelTransform<T,U,F>* self = (PMParallelTransform<T,U,F>*)arg;
+
+    for( ; first < last; first++ ) {
+      self->m_out[first] = self->m_fn( self->m_in[first] );
+    }
+  }
+};
+
+template <class T, class F> struct PMParallelReduce
+{
+  const T* m_data;
+  T*       m_partial;
+  ULONG    m_grain;
+  F&       m_fn;
+
+  PMParallelReduce( const T* data, T* partial, ULONG grain, F& fn )
+  : m_data( data ), m_partial( partial ), m_grain( grain ), m_fn( fn ) {}
+
+  static void body( ULONG first, ULONG last, void* arg )
+  {
+    PMParallelReduce<T,F>* self = (PMParallelReduce<T,F>*)arg;
+    T result = self->m_data[first];
+
+    // The chunks start at the multiples of the grain size.
+    while( ++first < last ) {
+      result = self->m_fn( result, self->m_data[first] );
+    }
+
+    self->m_partial[( last - 1 ) / self->m_grain ] = result;
+  }
+};
+
+template <class T, class L> struct PMParallelSort
+{
+  T*    m_src;
+  T*    m_dst;
+  ULONG m_count;
+  ULONG m_width;
+  ULONG m_grain;
+  L&    m_less;
+
+  PMParallelSort( T* data, T* temp, ULONG count, ULONG grain, L& less )
+  : m_src( data ), m_dst( temp ), m_count( count ), m_width( 0 ), m_grain( grain ), m_less( less ) {}
+
+  /** Sorts the chunks of the array. */
+  static void sort( ULONG first, ULONG last, void* arg );
+  /** Merges the pairs of the sorted runs. */
+  static void merge( ULONG first, ULONG last, void* arg );
+  /** Copies the merged array back. */
+  static void copy( ULONG first, ULONG last, void* arg );
+
+  /** Stable sort of a chunk using the temporary space of the same size. */
+  static void sort_chunk( T* data, T* temp, ULONG count, L& less );
+
+  /**
+   * Merges the part of two sorted runs starting at the specified
+   * position in the result. The elements of the first run go first
+   * if the elements are equal.
+   */
+
+  static void merge_part( const T* a, ULONG a_count, const T* b, ULONG b_count,
+                          T* out, ULONG first, ULONG last, L& less );
+};
+
+/**
+ * Parallel loop.
+ *
+ * Calls <i>fn( i )</i> for each index from <i>first</i> to <i>last</i>
+ * exclusive. The calls are made by several threads in any order, the
+ * function object is shared by them.
+ */
+
+template <class F> inline
+void parallel_for( ULONG first, ULONG last, F fn, ULONG grain = 0 )
+{
+  PMParallelFor<F> loop( fn );
+  PMParallel::run( first, last, grain, PMParallelFor<F>::body, &loop );
+}
+
+/**
+ * Parallel transformation.
+ *
+ * Stores <i>fn( in[i] )</i> into <i>out[i]</i> for each
+ * of <i>count</i> elements. The calls are made by several
+ * threads in any order.
+ */
+
+template <class T, class U, class F> inline
+void parallel_transform( const T* in, U* out, ULONG count, F fn, ULONG grain = 0 )
+{
+  PMParallelTransform<T,U,F> loop( in, out, fn );
+  PMParallel::run( 0, count, grain, PMParallelTransform<T,U,F>::body, &loop );
+}
+
+/**
+ * Parallel reduction.
+ *
+ * Combines <i>init</i> and <i>count</i> elements by the function
+ * <i>fn( a, b )</i>. The function must be associative, but needn't
+ * be commutative: the elements are combined in their order, only the
+ * grouping of the calls is unspecified. The type T must have the
+ * default constructor.
+ */
+
+template <class T, class F>
+T parallel_reduce( const T* data, ULONG count, T init, F fn, ULONG grain = 0 )
+{
+  if( !count ) {
+    return init;
+  }
+
+  ULONG chunks;
+  ULONG i;
+
+  grain  = PMParallel::grain( count, grain );
+  chunks = ( count + grain - 1 ) / grain;
+
+  T* partial = new T[ chunks ];
+  PMParallelReduce<T,F> loop( data, partial, grain, fn );
+  PMParallel::run( 0, count, grain, PMParallelReduce<T,F>::body, &loop );
+
+  for( i = 0; i < chunks; i++ ) {
+    init = fn( init, partial[i] );
+  }
+
+  delete[] partial;
+  return init;
+}
+
+/**
+ * Parallel stable sort.
+ *
+ * Sorts <i>count</i> elements by the merge sort in the order defined
+ * by <i>less( a, b )</i>, which returns TRUE if <i>a</i> must precede
+ * <i>b</i>. The equal elements keep their relative order. The chunks
+ * of the array are sorted by several threads and then merged by
+ * several threads too: each thread merges its own part of the result
+ * found by the binary search. The type T must have the default
+ * constructor, the sort uses the temporary array of the same size.
+ */
+
+template <class T, class L>
+void parallel_sort( T* data, ULONG count, L less, ULONG grain = 0 )
+{
+  if( count < 2 ) {
+    return;
+  }
+
+  grain = PMParallel::grain( count, grain );
+
+  if( grain < PM_PARALLEL_SORT_GRAIN ) {
+    grain = PM_PARALLEL_SORT_GRAIN;
+  }
+
+  T* temp = new T[ count ];
+  PMParallelSort<T,L> job( data, temp, count, grain, less );
+  ULONG chunks = ( count + grain - 1 ) / grain;
+
+  PMParallel::run( 0, chunks, 1, PMParallelSort<T,L>::sort, &job );
+
+  // The merged runs are doubled at each pass. The parts of the
+  // result are multiples of the grain size and so are the runs.
+  for( job.m_width = grain; job.m_width < count; job.m_width *= 2 )
+  {
+    T* src;
+
+    PMParallel::run( 0, chunks, 1, PMParallelSort<T,L>::merge, &job );
+
+    src = job.m_src;
+    job.m_src = job.m_dst;
+    job.m_dst = src;
+  }
+
+  if( job.m_src != data ) {
+    PMParallel::run( 0, chunks, 1, PMParallelSort<T,L>::copy, &job );
+  }
+
+  delete[] temp;
+}
+
+/* Sorts the chunks of the array.
+ */
+
+template <class T, class L>
+void PMParallelSort<T,L>::sort( ULONG first, ULONG last, void* arg )
+{
+  PMParallelSort<T,L>* self = (PMParallelSort<T,L>*)arg;
+
+  for( ; first < last; first++ )
+  {
+    ULONG start = first * self->m_grain;
+    ULONG count = self->m_count - start;
+
+    if( count > self->m_grain ) {
+      count = self->m_grain;
+    }
+
+    sort_chunk( self->m_src + start, self->m_dst + start, count, self->m_less );
+  }
+}
+
+/* Merges the pairs of the sorted runs.
+ */
+
+template <class T, class L>
+void PMParallelSort<T,L>::merge( ULONG first, ULONG last, void* arg )
+{
+  PMParallelSort<T,L>* self = (PMParallelSort<T,L>*)arg;
+
+  for( ; first < last; first++ )
+  {
+    ULONG start = first * self->m_grain;
+    ULONG end   = start + self->m_grain;
+    ULONG pair  = start - start % ( 2 * self->m_width );
+    ULONG a_end = pair + self->m_width;
+    ULONG b_end = a_end + self->m_width;
+
+    if( end   > self->m_count ) { end   = self->m_count; }
+    if( a_end > self->m_count ) { a_end = self->m_count; }
+    if( b_end > self->m_count ) { b_end = self->m_count; }
+
+    merge_part( self->m_src + pair,  a_end - pair,
+                self->m_src + a_end, b_end - a_end,
+                self->m_dst + pair,  start - pair, end - pair, self->m_less );
+  }
+}
+
+/* Copies the merged array back.
+ */
+
+template <class T, class L>
+void PMParallelSort<T,L>::copy( ULONG first, ULONG last, void* arg )
+{
+  PMParallelSort<T,L>* self = (PMParallelSort<T,L>*)arg;
+  ULONG start = first * self->m_grain;
+  ULONG end   = last  * self->m_grain;
+
+  if( end > self->m_count ) {
+    end = self->m_count;
+  }
+
+  // The sorted array is in the temporary one, which
+  // is the destination of the next merge pass.
+  for( ; start < end; start++ ) {
+    self->m_dst[start] = self->m_src[start];
+  }
+}
+
+/* Stable sort of a chunk using the temporary space of the same size.
+ */
+
+template <class T, class L>
+void PMParallelSort<T,L>::sort_chunk( T* data, T* temp, ULONG count, L& less )
+{
+  T*    src = data;
+  T*    dst = temp;
+  ULONG width;
+  ULONG i, j;
+
+  // The short runs are sorted by insertions.
+  for( i = 0; i < count; i += 16 )
+  {
+    ULONG end = i + 16 < count ? i + 16 : count;
+
+    for( j = i + 1; j < end; j++ )
+    {
+      T     value = data[j];
+      ULONG k = j;
+
+      for( ; k > i && less( value, data[k-1] ); k-- ) {
+        data[k] = data[k-1];
+      }
+
+      data[k] = value;
+    }
+  }
+
+  for( width = 16; width < count; width *= 2 )
+  {
+    T* swap;
+
+    for( i = 0; i < count; i += 2 * width )
+    {
+      ULONG a_end = i + width < count ? i + width : count;
+      ULONG b_end = a_end + width < count ? a_end + width : count;
+
+      merge_part( src + i, a_end - i, src + a_end, b_end - a_end,
+                  dst + i, 0, b_end - i, less );
+    }
+
+    swap = src;
+    src  = dst;
+    dst  = swap;
+  }
+
+  if( src != data ) {
+    for( i = 0; i < count; i++ ) {
+      data[i] = src[i];
+    }
+  }
+}
+
+/* Merges the part of two sorted runs starting at the specified
+ * position in the result.
+ */
+
+template <class T, class L>
+void PMParallelSort<T,L>::merge_part( const T* a, ULONG a_count, const T* b, ULONG b_count,
+                                      T* out, ULONG first, ULONG last, L& less )
+{
+  ULONG lo = first > b_count ? first - b_count : 0;
+  ULONG hi = first < a_count ? first : a_count;
+  ULONG i, j;
+
+  // Finds how many elements of the first run precede the part.
+  // An element of the first run goes before the equal ones of
+  // the second run.
+  while( lo < hi )
+  {
+    i = ( lo + hi ) / 2;
+    j = first - i;
+
+    if( j > 0 && !less( b[j-1], a[i] )) {
+      lo = i + 1;
+    } else {
+      hi = i;
+    }
+  }
+
+  i = lo;
+  j = first - lo;
+
+  for( ; first < last; first++ ) {
+    if( j >= b_count || ( i < a_count && !less( b[j], a[i] ))) {
+      out[first] = a[i++];
+    } else {
+      out[first] = b[j++];
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,485 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#include "pm_pipeline.h"
+#include "pm_memory.h"
+#include "pm_lock.h"
+#include "pm_error.h"
+#include "pm_smp.h"
+#include "pm_debuglog.h"
+
+/* Creates a pipeline object.
+ */
+
+PMPipeline::PMPipeline()
+
+: m_stages     ( NULL  ),
+  m_count      ( 0     ),
+  m_started    ( FALSE ),
+  m_pending    ( 0     ),
+  m_stats_since( now() ),
+  m_stats_until( 0     )
+{}
+
+/* Destroys the pipeline.
+ */
+
+PMPipeline::~PMPipeline()
+{
+  ULONG i;
+
+  cancel();
+
+  for( i = 0; i < m_count; i++ ) {
+    xfree( m_stages[i]->m_input.m_items );
+    delete m_stages[i];
+  }
+
+  xfree( m_stages );
+}
+
+/* Returns the current time in milliseconds.
+ */
+
+ULONG PMPipeline::now()
+{
+  ULONG ms;
+
+  DosQuerySysInfo( QSV_MS_COUNT, QSV_MS_COUNT, &ms, sizeof( ms ));
+  return ms;
+}
+
+/* Returns the time waited since the specified moment.
+ */
+
+ULONG PMPipeline::waited( ULONG start, ULONG current ) const
+{
+  // The waits started before the statistics were purged
+  // are accounted from that moment.
+  if( (LONG)( m_stats_since - start ) > 0 ) {
+    start = m_stats_since;
+  }
+
+  return current - start;
+}
+
+/* Returns the time the specified number of waits are lasting.
+ */
+
+ULONG PMPipeline::waiting( ULONG count, ULONG since, ULONG current ) const
+{
+  // The sum of the start times is kept instead of each
+  // of them, the unsigned arithmetic tolerates overflows.
+  ULONG total = count * current - since;
+  ULONG limit = count * ( current - m_stats_since );
+
+  return total < limit ? total : limit;
+}
+
+/* Adds a stage to the end of the pipeline.
+ */
+
+ULONG PMPipeline::add_stage( const char* name, stage fn, void* arg, ULONG threads,
+                             ULONG capacity, discard dispose )
+{
+  if( m_started ) {
+    PM_THROW_ERROR( PM_ERR_PIPELINE_STARTED, "PMLIB", "Pipeline is started." );
+  }
+
+  QStage* stage = new QStage;
+
+  stage->m_name      = name;
+  stage->m_fn        = fn;
+  stage->m_arg       = arg;
+  stage->m_dispose   = dispose;
+  stage->m_threads   = threads  ? threads  : 1;
+  stage->m_workers   = NULL;
+  stage->m_running   = 0;
+  stage->m_processed = 0;
+
+  QChannel* input = &stage->m_input;
+
+  input->m_capacity       = capacity ? capacity : 1;
+  input->m_items          = (void**)xmalloc( input->m_capacity * sizeof( void* ));
+  input->m_head           = 0;
+  input->m_size           = 0;
+  input->m_closed         = FALSE;
+  input->m_canceled       = FALSE;
+  input->m_max_size       = 0;
+  input->m_starved        = 0;
+  input->m_starving       = 0;
+  input->m_starving_since = 0;
+  input->m_stalled        = 0;
+  input->m_stalling       = 0;
+  input->m_stalling_since = 0;
+
+  m_stages = (QStage**)xrealloc( m_stages, ( m_count + 1 ) * sizeof( QStage* ));
+  m_stages[m_count] = stage;
+  return m_count++;
+}
+
+/* Starts the threads of all stages.
+ */
+
+void PMPipeline::start()
+{
+  ULONG i, j;
+
+  if( m_started ) {
+    return;
+  }
+
+  reset_stats();
+
+  for( i = 0; i < m_count; i++ )
+  {
+    QStage* stage = m_stages[i];
+
+    {
+      PMLock<PMFastMutex> lock( stage->m_input.m_mutex );
+      stage->m_input.m_closed   = FALSE;
+      stage->m_input.m_canceled = FALSE;
+    }
+
+    stage->m_running = stage->m_threads;
+    stage->m_workers = new QWorker*[ stage->m_threads ];
+
+    for( j = 0; j < stage->m_threads; j++ ) {
+      stage->m_workers[j] = new QWorker( this, i );
+    }
+  }
+
+  m_started = TRUE;
+
+  for( i = 0; i < m_count; i++ ) {
+    for( j = 0; j < m_stages[i]->m_threads; j++ ) {
+      m_stages[i]->m_workers[j]->start();
+    }
+  }
+}
+
+/* Adds an item to the queue. Blocks while the queue is full.
+ */
+
+BOOL PMPipeline::put( QChannel* channel, void* item )
+{
+  PMLock<PMFastMutex> lock( channel->m_mutex );
+
+  while( channel->m_size == channel->m_capacity &&
+         !channel->m_closed && !channel->m_canceled )
+  {
+    ULONG start = now();
+
+    channel->m_stalling++;
+    channel->m_stalling_since += start;
+    channel->m_not_full.wait( channel->m_mutex );
+    channel->m_stalling--;
+    channel->m_stalling_since -= start;
+    channel->m_stalled += waited( start, now());
+  }
+
+  if( channel->m_closed || channel->m_canceled ) {
+    return FALSE;
+  }
+
+  channel->m_items[( channel->m_head + channel->m_size++ ) % channel->m_capacity ] = item;
+
+  if( channel->m_size > channel->m_max_size ) {
+    channel->m_max_size = channel->m_size;
+  }
+
+  channel->m_not_empty.signal();
+  return TRUE;
+}
+
+/* Takes an item from the queue. Blocks while the queue is empty.
+ */
+
+BOOL PMPipeline::get( QChannel* channel, void** item )
+{
+  PMLock<PMFastMutex> lock( channel->m_mutex );
+
+  while( !channel->m_size && !channel->m_closed && !channel->m_canceled )
+  {
+    ULONG start = now();
+
+    channel->m_starving++;
+    channel->m_starving_since += start;
+    channel->m_not_empty.wait( channel->m_mutex );
+    channel->m_starving--;
+    channel->m_starving_since -= start;
+    channel->m_starved += waited( start, now());
+  }
+
+  // The closed queue gives out the items left in it.
+  if( channel->m_canceled || !channel->m_size ) {
+    return FALSE;
+  }
+
+  *item = channel->m_items[ channel->m_head ];
+  channel->m_head = ( channel->m_head + 1 ) % channel->m_capacity;
+  channel->m_size--;
+  channel->m_not_full.signal();
+  return TRUE;
+}
+
+/* Closes the queue. The items left in the queue can be taken.
+ */
+
+void PMPipeline::close( QChannel* channel )
+{
+  PMLock<PMFastMutex> lock( channel->m_mutex );
+
+  channel->m_closed = TRUE;
+  channel->m_not_empty.broadcast();
+  channel->m_not_full.broadcast();
+}
+
+/* Accounts an item leaving the pipeline.
+ */
+
+void PMPipeline::done()
+{
+  if( xadd((ULONG&)m_pending, (ULONG)-1 ) == 1 ) {
+    m_flushed.post();
+  }
+}
+
+/* Writes an item into the pipeline.
+ */
+
+BOOL PMPipeline::push( void* item )
+{
+  xadd((ULONG&)m_pending, 1UL );
+
+  if( !m_count || !put( &m_stages[0]->m_input, item )) {
+    done();
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* Waits until all items written before are processed.
+ */
+
+void PMPipeline::flush()
+{
+  // The notification is reset before the check, so the
+  // post after the last item can't be lost.
+  for(;;) {
+    m_flushed.reset();
+    if( !m_pending ) {
+      break;
+    }
+    m_flushed.wait();
+  }
+}
+
+/* Stage thread function.
+ */
+
+void PMPipeline::run( ULONG index )
+{
+  QStage* stage = m_stages[index];
+  QStage* next  = index + 1 < m_count ? m_stages[index+1] : NULL;
+  void*   item;
+
+  while( get( &stage->m_input, &item ))
+  {
+    item = stage->m_fn( item, stage->m_arg );
+    xadd((ULONG&)stage->m_processed, 1UL );
+
+    if( !item || !next ) {
+      done();
+    } else if( !put( &next->m_input, item )) {
+      // The pipeline is canceled.
+      if( next->m_dispose ) {
+        next->m_dispose( item );
+      }
+      done();
+    }
+  }
+
+  // The last thread of the stage closes the input of
+  // the next one, which finishes the items left there.
+  if( xadd((ULONG&)stage->m_running, (ULONG)-1 ) == 1 && next ) {
+    close( &next->m_input );
+  }
+}
+
+/* Waits until the threads of all stages are finished.
+ */
+
+void PMPipeline::join()
+{
+  ULONG i, j;
+
+  for( i = 0; i < m_count; i++ )
+  {
+    QStage* stage = m_stages[i];
+
+    for( j = 0; j < stage->m_threads; j++ ) {
+      stage->m_workers[j]->join();
+      delete stage->m_workers[j];
+    }
+
+    delete[] stage->m_workers;
+    stage->m_workers = NULL;
+  }
+
+  m_stats_until = now();
+  m_started = FALSE;
+}
+
+/* Processes all written items and stops the pipeline.
+ */
+
+void PMPipeline::drain()
+{
+  if( m_count ) {
+    close( &m_stages[0]->m_input );
+  }
+  if( m_started ) {
+    join();
+  }
+}
+
+/* Stops the pipeline as soon as possible.
+ */
+
+void PMPipeline::cancel()
+{
+  ULONG i;
+
+  for( i = 0; i < m_count; i++ )
+  {
+    QChannel* channel = &m_stages[i]->m_input;
+    PMLock<PMFastMutex> lock( channel->m_mutex );
+
+    channel->m_canceled = TRUE;
+    channel->m_not_empty.broadcast();
+    channel->m_not_full.broadcast();
+  }
+
+  if( m_started ) {
+    join();
+  }
+
+  for( i = 0; i < m_count; i++ )
+  {
+    QStage*   stage   = m_stages[i];
+    QChannel* channel = &stage->m_input;
+    PMLock<PMFastMutex> lock( channel->m_mutex );
+
+    for( ; channel->m_size; channel->m_size-- )
+    {
+      if( stage->m_dispose ) {
+        stage->m_dispose( channel->m_items[ channel->m_head ]);
+      }
+
+      channel->m_head = ( channel->m_head + 1 ) % channel->m_capacity;
+      done();
+    }
+  }
+}
+
+/* Returns the statistics of the specified stage.
+ */
+
+void PMPipeline::stage_stats( ULONG index, metrics* stats )
+{
+  QStage*   stage   = m_stages[index];
+  QChannel* input   = &stage->m_input;
+  QChannel* output  = index + 1 < m_count ? &m_stages[index+1]->m_input : NULL;
+  ULONG     current = m_started ? now() : m_stats_until;
+  ULONG     elapsed = (LONG)( current - m_stats_since ) > 0 ? current - m_stats_since : 0;
+  double    total   = (double)elapsed * stage->m_threads;
+
+  stats->name       = stage->m_name;
+  stats->threads    = stage->m_threads;
+  stats->processed  = stage->m_processed;
+  stats->throughput = elapsed ? (ULONG)( stats->processed * 1000.0 / elapsed ) : 0;
+  stats->stalled    = 0;
+
+  {
+    PMLock<PMFastMutex> lock( input->m_mutex );
+
+    stats->depth     = input->m_size;
+    stats->max_depth = input->m_max_size;
+    stats->starved   = input->m_starved +
+                       waiting( input->m_starving, input->m_starving_since, current );
+  }
+
+  if( output ) {
+    PMLock<PMFastMutex> lock( output->m_mutex );
+
+    stats->stalled = output->m_stalled +
+                     waiting( output->m_stalling, output->m_stalling_since, current );
+  }
+
+  if( total > (double)stats->starved + stats->stalled ) {
+    stats->busy = (ULONG)(( total - stats->starved - stats->stalled ) * 100.0 / total );
+  } else {
+    stats->busy = 0;
+  }
+}
+
+/* Purges the statistics.
+ */
+
+void PMPipeline::reset_stats()
+{
+  ULONG i;
+
+  m_stats_since = now();
+
+  for( i = 0; i < m_count; i++ )
+  {
+    QChannel* channel = &m_stages[i]->m_input;
+    PMLock<PMFastMutex> lock( channel->m_mutex );
+
+    m_stages[i]->m_processed = 0;
+    channel->m_max_size = channel->m_size;
+    channel->m_starved  = 0;
+    channel->m_stalled  = 0;
+  }
+}
+
+/* Writes the string to the file or to the debug log.
+ */
+
+static void dump_line( FILE* file, const char* line )
+{
+  if( file ) {
+    fputs( line, file );
+  } else {
+    DEBUGLOG(( "%s", line ));
+  }
+}
+
+/* Writes the snapshot of the statistics.
+ */
+
+void PMPipeline::dump( const char* name, FILE* file )
+{
+  metrics stats;
+  char    line[256];
+  ULONG   i;
+
+  for( i = 0; i < m_count; i++ )
+  {
+    stage_stats( i, &stats );
+    snprintf( line, sizeof( line ), "pipeline %s: stage %s: threads %lu, processed %lu, %lu per second, "
+              "queue %lu of %lu, max %lu, starved %lu ms, stalled %lu ms, busy %lu%%\n",
+              name, stats.name ? stats.name : "unnamed", stats.threads, stats.processed,
+              stats.throughput, stats.depth, m_stages[i]->m_input.m_capacity, stats.max_depth,
+              stats.starved, stats.stalled, stats.busy );
+    dump_line( file, line );
+  }
+
+  if( file ) {
+    fflush( file );
+  }
+}
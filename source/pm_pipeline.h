@@ -0,0 +1,265 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_PIPELINE_H
+#define PM_PIPELINE_H
+
+#include <stdio.h>
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_thread.h"
+#include "pm_fastmutex.h"
+#include "pm_condition.h"
+#include "pm_notify.h"
+
+#ifndef PM_PIPELINE_CAPACITY
+
+/**
+ * Sets the default number of items that can wait in the input
+ * queue of a stage. When the queue is full, the previous stage
+ * is blocked until the stage takes an item.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_PIPELINE_CAPACITY 16
+#endif
+
+/**
+ * Pipeline class.
+ *
+ * The PMPipeline class passes the items through a sequence of stages.
+ * Each stage is a function executed by the specified number of its
+ * own threads. The stages are joined by the bounded queues, so a slow
+ * stage holds back the previous ones instead of accumulating the items
+ * in memory. A stage executed by several threads can reorder the items.
+ *
+ * An item is a pointer to the application data. It is written into
+ * the pipeline by the <i>push</i> method and is passed to the function
+ * of the first stage. The value returned by the stage function is passed
+ * to the next stage. If the stage function returns NULL, the item leaves
+ * the pipeline. The value returned by the last stage is ignored.
+ *
+ * The pipeline can be stopped in two ways: the <i>drain</i> method
+ * processes all written items and the <i>cancel</i> method discards
+ * the items not processed yet by the discard functions of the stages.
+ * A stopped pipeline can be started again.
+ *
+ * Each stage accounts the processed items and the time its threads
+ * spend waiting for the input and for the space in the output queue.
+ * The stage whose threads rarely wait while the previous stages wait
+ * for the output is the bottleneck.
+ *
+ * The stage functions must not throw exceptions.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+class PMPipeline : public PMNonCopyable
+{
+  public:
+
+    /** Stage function. Returns the item passed to the next stage or NULL. */
+    typedef void* (*stage)( void* item, void* arg );
+    /** Discard function. */
+    typedef void  (*discard)( void* item );
+
+    /** Stage statistics. */
+    struct metrics {
+      const char* name;        /**< Name of the stage.                               */
+      ULONG       threads;     /**< Number of the threads of the stage.              */
+      ULONG       processed;   /**< Number of the processed items.                   */
+      ULONG       throughput;  /**< Number of the processed items per second.        */
+      ULONG       depth;       /**< Current number of the items in the input queue.  */
+      ULONG       max_depth;   /**< Maximum number of the items in the input queue.  */
+      ULONG       starved;     /**< Time in ms the threads waited for the input.     */
+      ULONG       stalled;     /**< Time in ms the threads waited for the output.    */
+      ULONG       busy;        /**< Percentage of the time the threads were busy.    */
+    };
+
+    /** Creates a pipeline object. */
+    PMPipeline();
+
+    /**
+     * Destroys the pipeline.
+     *
+     * Cancels the pipeline if it is started.
+     */
+
+   ~PMPipeline();
+
+    /**
+     * Adds a stage to the end of the pipeline.
+     *
+     * The stages must be added before the pipeline is started.
+     *
+     * @param name      The name of the stage used by the statistics.
+     * @param fn        The stage function.
+     * @param arg       The argument passed to the stage function.
+     * @param threads   The number of the threads executing the stage.
+     * @param capacity  The maximum number of the items in the input
+     *                  queue of the stage.
+     * @param dispose   The function called for the items discarded
+     *                  from the input queue of the stage or NULL.
+     *
+     * @return The index of the stage.
+     */
+
+    ULONG add_stage( const char* name, stage fn, void* arg, ULONG threads = 1,
+                     ULONG capacity = PM_PIPELINE_CAPACITY, discard dispose = NULL );
+
+    /** Returns the number of the stages. */
+    ULONG stages() const { return m_count; }
+
+    /** Starts the threads of all stages. */
+    void start();
+
+    /** Is the pipeline started. */
+    BOOL started() const { return m_started; }
+
+    /**
+     * Writes an item into the pipeline.
+     *
+     * If the input queue of the first stage is full, the push
+     * method blocks the calling thread until there is room.
+     *
+     * @return TRUE, if the item is accepted. FALSE, if the pipeline
+     *         is drained or canceled, the item isn't processed then.
+     */
+
+    BOOL push( void* item );
+
+    /**
+     * Waits until all items written before are processed.
+     *
+     * The pipeline keeps running. If other threads keep
+     * writing items, the method can wait longer.
+     */
+
+    void flush();
+
+    /**
+     * Processes all written items and stops the pipeline.
+     *
+     * The further items aren't accepted. Each stage is stopped
+     * when all items of the previous stages are processed.
+     */
+
+    void drain();
+
+    /**
+     * Stops the pipeline as soon as possible.
+     *
+     * The items which are being processed now are finished by the current
+     * stages and the other items are discarded by the discard functions.
+     */
+
+    void cancel();
+
+    /**
+     * Returns the statistics of the specified stage.
+     *
+     * The statistics are collected since the pipeline is
+     * started or since the last <i>reset_stats</i> call.
+     */
+
+    void stage_stats( ULONG index, metrics* stats );
+
+    /** Purges the statistics. */
+    void reset_stats();
+
+    /**
+     * Writes the snapshot of the statistics.
+     *
+     * @param name      The name of the pipeline in the snapshot.
+     * @param file      The file to which the snapshot is written,
+     *                  the standard error by default. If it is NULL,
+     *                  the snapshot is written to the debug log,
+     *                  which exists in the debug builds only.
+     */
+
+    void dump( const char* name, FILE* file = stderr );
+
+  private:
+
+    struct QChannel {
+      PMFastMutex    m_mutex;
+      PMCondition    m_not_empty;
+      PMCondition    m_not_full;
+      void**         m_items;
+      ULONG          m_capacity;
+      ULONG          m_head;
+      ULONG          m_size;
+      BOOL           m_closed;
+      BOOL           m_canceled;
+      ULONG          m_max_size;
+      ULONG          m_starved;
+      ULONG          m_starving;
+      ULONG          m_starving_since;
+      ULONG          m_stalled;
+      ULONG          m_stalling;
+      ULONG          m_stalling_since;
+    };
+
+    class QWorker : public PMThread {
+      public:
+        QWorker( PMPipeline* pipeline, ULONG index ) : m_pipeline( pipeline ), m_index( index ) {
+          message_queue( FALSE );
+        }
+      protected:
+        virtual void operator()() { m_pipeline->run( m_index ); }
+      private:
+        PMPipeline* m_pipeline;
+        ULONG       m_index;
+    };
+
+    struct QStage {
+      const char*    m_name;
+      stage          m_fn;
+      void*          m_arg;
+      discard        m_dispose;
+      ULONG          m_threads;
+      QWorker**      m_workers;
+      volatile ULONG m_running;
+      volatile ULONG m_processed;
+      QChannel       m_input;
+    };
+
+    friend class QWorker;
+
+    QStage**       m_stages;
+    ULONG          m_count;
+    BOOL           m_started;
+    volatile ULONG m_pending;
+    PMNotify       m_flushed;
+    ULONG          m_stats_since;
+    ULONG          m_stats_until;
+
+    /** Returns the current time in milliseconds. */
+    static ULONG now();
+    /** Returns the time waited since the specified moment. */
+    ULONG waited( ULONG start, ULONG current ) const;
+    /** Returns the time the specified number of waits are lasting. */
+    ULONG waiting( ULONG count, ULONG since, ULONG current ) const;
+
+    /** Adds an item to the queue. Blocks while the queue is full. */
+    BOOL put( QChannel* channel, void* item );
+    /** Takes an item from the queue. Blocks while the queue is empty. */
+    BOOL get( QChannel* channel, void** item );
+    /** Closes the queue. The items left in the queue can be taken. */
+    void close( QChannel* channel );
+    /** Accounts an item leaving the pipeline. */
+    void done();
+    /** Waits until the threads of all stages are finished. */
+    void join();
+    /** Stage thread function. */
+    void run( ULONG index );
+};
+
+#endif
@@ -3,23 +3,964 @@
  */
 
 #include "pm_queue.h"
+#include "pm_lock.h"
 #include "pm_memory.h"
 #include "pm_error.h"
+#include "pm_debuglog.h"
+
+#include <string.h>
+
+/* The elements and the payloads are aligned on this boundary.
+ */
+
+#define PM_QUEUE_ALIGN( size ) ((( size ) + sizeof( double ) - 1 ) & ~( sizeof( double ) - 1 ))
 
 /* Creates a queue object.
  */
 
-PMQueue::PMQueue()
+PMQueue::PMQueue()
+
+: m_ranges      ( 0     ),
+  m_timers      ( by_due_time ),
+  m_sequence    ( 0     ),
+  m_closed      ( FALSE ),
+  m_waiters     ( NULL  ),
+  m_last_waiter ( NULL  ),
+  m_free_waiters( NULL  ),
+  m_watchers    ( NULL  ),
+  m_free_slab   ( NULL  ),
+  m_free_count  ( 0     ),
+  m_pool_limit  ( PM_QUEUE_POOL_LIMIT ),
+  m_pool_hits   ( 0     ),
+  m_pool_misses ( 0     ),
+  m_aging_rate  ( 0     ),
+  m_aging_ceiling( 0    ),
+  m_aged_at     ( 0     ),
+  m_collect     ( FALSE ),
+  m_depth       ( 0     ),
+  m_max_depth   ( 0     ),
+  m_written     ( 0     ),
+  m_read        ( 0     ),
+  m_node_size   ( PM_QUEUE_ALIGN( sizeof( QNode ))),
+  m_payload_size( 0     ),
+  m_dispose     ( NULL  )
+{
+  memset( m_stats, 0, sizeof( m_stats ));
+  memset( m_codes, 0, sizeof( m_codes ));
+  m_ready[0] = new QHeap( by_priority );
+}
+
+/* Creates a queue object storing the payloads inline.
+ */
+
+PMQueue::PMQueue( ULONG payload_size, dispose destroy )
+
+: m_ranges      ( 0     ),
+  m_timers      ( by_due_time ),
+  m_sequence    ( 0     ),
+  m_closed      ( FALSE ),
+  m_waiters     ( NULL  ),
+  m_last_waiter ( NULL  ),
+  m_free_waiters( NULL  ),
+  m_watchers    ( NULL  ),
+  m_free_slab   ( NULL  ),
+  m_free_count  ( 0     ),
+  m_pool_limit  ( PM_QUEUE_POOL_LIMIT ),
+  m_pool_hits   ( 0     ),
+  m_pool_misses ( 0     ),
+  m_aging_rate  ( 0     ),
+  m_aging_ceiling( 0    ),
+  m_aged_at     ( 0     ),
+  m_collect     ( FALSE ),
+  m_depth       ( 0     ),
+  m_max_depth   ( 0     ),
+  m_written     ( 0     ),
+  m_read        ( 0     ),
+  m_node_size   ( PM_QUEUE_ALIGN( sizeof( QNode )) + PM_QUEUE_ALIGN( payload_size )),
+  m_payload_size( payload_size ),
+  m_dispose     ( destroy )
+{
+  memset( m_stats, 0, sizeof( m_stats ));
+  memset( m_codes, 0, sizeof( m_codes ));
+  m_ready[0] = new QHeap( by_priority );
+}
+
+/* Destroys the queue object.
+ */
+
+PMQueue::~PMQueue()
+{
+  QSlab*   slab;
+  QWaiter* waiter;
+  QWatch*  watch;
+  ULONG    i;
+
+  clear();
+
+  // After clearing all slabs contain unused elements only,
+  // therefore all of them are in the list of the free slabs.
+  while(( slab = m_free_slab ) != NULL ) {
+    m_free_slab = slab->m_next_slab;
+    xfree( slab );
+  }
+  while(( waiter = m_free_waiters ) != NULL ) {
+    m_free_waiters = waiter->m_next;
+    delete waiter;
+  }
+  while(( watch = m_watchers ) != NULL ) {
+    m_watchers = watch->m_next;
+    delete watch;
+  }
+  for( i = 0; i <= m_ranges; i++ ) {
+    delete m_ready[i];
+  }
+}
+
+/* Adds a slab of unused elements to the pool.
+ */
+
+void PMQueue::grow()
+{
+  QSlab* slab;
+  QNode* node;
+  ULONG  i;
+
+  slab = (QSlab*)xmalloc( sizeof( QSlab ) - sizeof( slab->m_nodes )
+                          + PM_QUEUE_SLAB_SIZE * m_node_size );
+  slab->m_prev_slab  = NULL;
+  slab->m_next_slab  = m_free_slab;
+  slab->m_free_node  = NULL;
+  slab->m_free_count = PM_QUEUE_SLAB_SIZE;
+
+  for( i = PM_QUEUE_SLAB_SIZE; i > 0; i-- ) {
+    node = node_of( slab, i - 1 );
+    node->m_slab      = slab;
+    node->m_next_free = slab->m_free_node;
+    slab->m_free_node = node;
+
+    if( m_payload_size ) {
+      // The payload storage is placed just after the element.
+      node->m_data = (char*)node + PM_QUEUE_ALIGN( sizeof( QNode ));
+    }
+  }
+
+  if( m_free_slab ) {
+    m_free_slab->m_prev_slab = slab;
+  }
+
+  m_free_slab   = slab;
+  m_free_count += PM_QUEUE_SLAB_SIZE;
+  ++m_pool_misses;
+}
+
+/* Makes sure the pool contains the specified number of unused elements.
+ */
+
+void PMQueue::reserve_nodes( ULONG count )
+{
+  while( m_free_count < count ) {
+    grow();
+  }
+}
+
+/* Takes an unused element from the pool.
+ */
+
+PMQueue::QNode* PMQueue::alloc_node( ULONG request )
+{
+  QSlab* slab;
+  QNode* node;
+
+  if( m_free_slab ) {
+    ++m_pool_hits;
+  } else {
+    grow();
+  }
+
+  slab = m_free_slab;
+  node = slab->m_free_node;
+  slab->m_free_node = node->m_next_free;
+  --m_free_count;
+
+  if( !--slab->m_free_count ) {
+    // The slab is exhausted and must be removed from the list of the free slabs.
+    if(( m_free_slab = slab->m_next_slab ) != NULL ) {
+      m_free_slab->m_prev_slab = NULL;
+    }
+    slab->m_next_slab = NULL;
+  }
+
+  node->m_request = request;
+
+  if( ++m_depth > m_max_depth ) {
+    m_max_depth = m_depth;
+  }
+
+  if( m_collect ) {
+    QCode* code = code_of( request );
+
+    ++code->m_written;
+    ++code->m_queued;
+    ++m_written;
+  }
+
+  return node;
+}
+
+/* Returns an element to the pool.
+ */
+
+void PMQueue::free_node( QNode* node )
+{
+  QSlab* slab = node->m_slab;
+
+  --m_depth;
+
+  if( !slab->m_free_count++ ) {
+    slab->m_prev_slab = NULL;
+    slab->m_next_slab = m_free_slab;
+
+    if( m_free_slab ) {
+      m_free_slab->m_prev_slab = slab;
+    }
+    m_free_slab = slab;
+  }
+
+  node->m_next_free = slab->m_free_node;
+  slab->m_free_node = node;
+  ++m_free_count;
+
+  if( slab->m_free_count == PM_QUEUE_SLAB_SIZE && m_free_count > m_pool_limit )
+  {
+    if( slab->m_prev_slab ) {
+      slab->m_prev_slab->m_next_slab = slab->m_next_slab;
+    } else {
+      m_free_slab = slab->m_next_slab;
+    }
+    if( slab->m_next_slab ) {
+      slab->m_next_slab->m_prev_slab = slab->m_prev_slab;
+    }
+
+    m_free_count -= PM_QUEUE_SLAB_SIZE;
+    xfree( slab );
+  }
+}
+
+/* Sets the maximum number of unused elements retained by the pool.
+ */
+
+void PMQueue::pool_limit( ULONG limit )
+{
+  QSlab* slab;
+  QSlab* next;
+
+  m_data_mutex.request();
+  m_pool_limit = limit;
+
+  for( slab = m_free_slab; slab && m_free_count > m_pool_limit; slab = next )
+  {
+    next = slab->m_next_slab;
+
+    if( slab->m_free_count == PM_QUEUE_SLAB_SIZE ) {
+      if( slab->m_prev_slab ) {
+        slab->m_prev_slab->m_next_slab = next;
+      } else {
+        m_free_slab = next;
+      }
+      if( next ) {
+        next->m_prev_slab = slab->m_prev_slab;
+      }
+
+      m_free_count -= PM_QUEUE_SLAB_SIZE;
+      xfree( slab );
+    }
+  }
+
+  m_data_mutex.release();
+}
+
+/* Returns TRUE if the node a must be read before the node b.
+ * The effective priorities are compared. The sequence numbers are compared with respect to a wrap-around.
+ */
+
+BOOL PMQueue::by_priority( const QNode* a, const QNode* b )
+{
+  if( a->m_effective != b->m_effective ) {
+    return a->m_effective > b->m_effective;
+  } else {
+    return (LONG)( a->m_sequence - b->m_sequence ) < 0;
+  }
+}
+
+/* Returns TRUE if the node a is due before the node b.
+ * The time values are compared with respect to a wrap-around.
+ */
+
+BOOL PMQueue::by_due_time( const QNode* a, const QNode* b )
+{
+  if( a->m_due_time != b->m_due_time ) {
+    return (LONG)( a->m_due_time - b->m_due_time ) < 0;
+  } else {
+    return (LONG)( a->m_sequence - b->m_sequence ) < 0;
+  }
+}
+
+/* Returns the value of the system millisecond counter.
+ */
+
+ULONG PMQueue::now()
+{
+  ULONG ms;
+  DosQuerySysInfo( QSV_MS_COUNT, QSV_MS_COUNT, &ms, sizeof( ms ));
+  return ms;
+}
+
+/* Creates an empty heap.
+ */
+
+PMQueue::QHeap::QHeap( precedes fn, ULONG first, ULONG last )
+
+: m_nodes   ( NULL  ),
+  m_size    ( 0     ),
+  m_capacity( 0     ),
+  m_pending ( 0     ),
+  m_first   ( first ),
+  m_last    ( last  ),
+  m_precedes( fn    )
+{}
+
+/* Destroys the heap. The elements must be removed before.
+ */
+
+PMQueue::QHeap::~QHeap() {
+  xfree( m_nodes );
+}
+
+/* Makes room in the heap for the specified number of elements
+ * in addition to the room kept for the pending elements.
+ */
+
+void PMQueue::QHeap::reserve( ULONG count )
+{
+  count += m_pending;
+
+  if( m_capacity - m_size < count )
+  {
+    ULONG capacity = m_capacity ? m_capacity : 16;
+
+    while( capacity - m_size < count ) {
+      capacity *= 2;
+    }
+
+    m_nodes = (QNode**)xrealloc( m_nodes, capacity * sizeof( QNode* ));
+    m_capacity = capacity;
+  }
+}
+
+/* Adds an element to the heap. The room for the
+ * element must be reserved before.
+ */
+
+void PMQueue::QHeap::push( QNode* node )
+{
+  m_nodes[m_size] = node;
+  sift_up( m_size++ );
+}
+
+/* Removes the element at the specified position from the heap.
+ */
+
+PMQueue::QNode* PMQueue::QHeap::remove( ULONG pos )
+{
+  QNode* node = m_nodes[pos];
+
+  if( pos < --m_size ) {
+    m_nodes[pos] = m_nodes[m_size];
+    sift_down( pos );
+    sift_up( pos );
+  }
+
+  return node;
+}
+
+/* Moves the node at the specified position toward the heap root.
+ */
+
+void PMQueue::QHeap::sift_up( ULONG pos )
+{
+  QNode* node = m_nodes[pos];
+
+  while( pos > 0 ) {
+    ULONG parent = ( pos - 1 ) / 2;
+
+    if( !m_precedes( node, m_nodes[parent] )) {
+      break;
+    }
+
+    m_nodes[pos] = m_nodes[parent];
+    pos = parent;
+  }
+
+  m_nodes[pos] = node;
+}
+
+/* Moves the node at the specified position toward the heap leaves.
+ */
+
+void PMQueue::QHeap::sift_down( ULONG pos )
+{
+  QNode* node = m_nodes[pos];
+
+  for(;;) {
+    ULONG child = pos * 2 + 1;
+
+    if( child >= m_size ) {
+      break;
+    }
+    if( child + 1 < m_size && m_precedes( m_nodes[child+1], m_nodes[child] )) {
+      ++child;
+    }
+    if( !m_precedes( m_nodes[child], node )) {
+      break;
+    }
+
+    m_nodes[pos] = m_nodes[child];
+    pos = child;
+  }
+
+  m_nodes[pos] = node;
+}
+
+/* Registers a range of event codes.
+ */
+
+void PMQueue::add_range( ULONG first, ULONG last )
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  QHeap* others = m_ready[0];
+  QHeap* range;
+  ULONG  i, done, pending;
+
+  for( i = 1; i <= m_ranges; i++ ) {
+    if( first <= m_ready[i]->m_last && last >= m_ready[i]->m_first ) {
+      PM_THROW_ERROR( PM_ERR_TOO_MANY_RANGES, "PMLIB", "Overlapped queue ranges." );
+    }
+  }
+  if( m_ranges == PM_QUEUE_MAX_RANGES ) {
+    PM_THROW_ERROR( PM_ERR_TOO_MANY_RANGES, "PMLIB", "Too many queue ranges." );
+  }
+
+  range = new QHeap( by_priority, first, last );
+  m_ready[++m_ranges] = range;
+
+  // The ranges don't overlap, therefore the elements having event codes
+  // in the new range can be found among the other elements only.
+  for( i = 0, pending = 0; i < m_timers.m_size; i++ ) {
+    if( m_timers.m_nodes[i]->m_request >= first && m_timers.m_nodes[i]->m_request <= last ) {
+      ++pending;
+    }
+  }
+
+  range->reserve( others->m_size + pending );
+  range->m_pending   = pending;
+  others->m_pending -= pending;
+
+  for( i = 0, done = 0; i < others->m_size; i++ ) {
+    QNode* node = others->m_nodes[i];
+
+    if( node->m_request >= first && node->m_request <= last ) {
+      range->push( node );
+    } else {
+      others->m_nodes[done++] = node;
+    }
+  }
+
+  others->m_size = done;
+
+  for( i = done / 2; i > 0; i-- ) {
+    others->sift_down( i - 1 );
+  }
+}
+
+/* Returns the index of the sub-queue intended for the specified event code.
+ */
+
+ULONG PMQueue::index_of( ULONG request ) const
+{
+  ULONG i;
+
+  for( i = 1; i <= m_ranges; i++ ) {
+    if( request >= m_ready[i]->m_first && request <= m_ready[i]->m_last ) {
+      return i;
+    }
+  }
+
+  return 0;
+}
+
+/* Adds an element to the ready elements sub-queues. The room
+ * for the element must be reserved before.
+ */
+
+void PMQueue::put( QNode* node )
+{
+  QHeap* heap = range_of( node->m_request );
+
+  node->m_sequence  = m_sequence++;
+  node->m_effective = node->m_priority;
+
+  if( m_collect || m_aging_rate ) {
+    node->m_ready_time = now();
+  }
+
+  heap->push( node );
+}
+
+/* Moves the elements whose time has come to the ready elements sub-queues.
+ */
+
+void PMQueue::promote( ULONG now )
+{
+  while( m_timers.m_size && (LONG)( m_timers.m_nodes[0]->m_due_time - now ) <= 0 )
+  {
+    // The room for the element was kept by the write_at method.
+    --range_of( m_timers.m_nodes[0]->m_request )->m_pending;
+    put( m_timers.remove( 0 ));
+  }
+}
+
+/* Recalculates the effective priorities of the ready elements.
+ */
+
+void PMQueue::age( ULONG now )
+{
+  ULONG i, j;
+
+  for( i = 0; i <= m_ranges; i++ )
+  {
+    QHeap* heap = m_ready[i];
+
+    for( j = 0; j < heap->m_size; j++ ) {
+      QNode* node = heap->m_nodes[j];
+
+      if( node->m_priority < m_aging_ceiling ) {
+        ULONG levels = ( now - node->m_ready_time ) / m_aging_rate;
+
+        if( levels < m_aging_ceiling - node->m_priority ) {
+          node->m_effective = node->m_priority + levels;
+        } else {
+          node->m_effective = m_aging_ceiling;
+        }
+      }
+    }
+
+    for( j = heap->m_size / 2; j > 0; j-- ) {
+      heap->sift_down( j - 1 );
+    }
+  }
+
+  m_aged_at = now;
+}
+
+/* Promotes the pending elements and ages the ready
+ * elements if it is needed.
+ */
+
+void PMQueue::refresh( ULONG now )
+{
+  promote( now );
+
+  if( m_aging_rate && now - m_aged_at >= m_aging_rate ) {
+    age( now );
+  }
+}
+
+/* Returns the counters of the specified event code.
+ */
+
+PMQueue::QCode* PMQueue::code_of( ULONG request )
+{
+  ULONG i;
+
+  for( i = 0; i < PM_QUEUE_STAT_CODES; i++ )
+  {
+    QCode* code = &m_codes[( request + i ) % PM_QUEUE_STAT_CODES ];
+
+    // The counters of an event code are never removed,
+    // therefore the probing can stop at the first unused counters.
+    if( !code->m_written ) {
+      code->m_request = request;
+      return code;
+    }
+    if( code->m_request == request ) {
+      return code;
+    }
+  }
+
+  m_codes[PM_QUEUE_STAT_CODES].m_request = 0xFFFFFFFFUL;
+  return &m_codes[PM_QUEUE_STAT_CODES];
+}
+
+/* Accounts the wait time of the read element.
+ */
+
+void PMQueue::account( const QNode* node, ULONG now )
+{
+  QStats* stats = &m_stats[ node->m_priority < PM_QUEUE_STAT_CLASSES ?
+                            node->m_priority : PM_QUEUE_STAT_CLASSES - 1 ];
+  ULONG   waited = now - node->m_ready_time;
+  QCode*  code   = code_of( node->m_request );
+  ULONG   bucket;
+
+  // The element could be written before the collection was enabled.
+  if( code->m_queued ) {
+    --code->m_queued;
+  }
+
+  ++m_read;
+
+  for( bucket = 0; bucket < 31 && waited >> bucket; bucket++ )
+  {}
+
+  stats->m_count++;
+  stats->m_total += waited;
+  stats->m_buckets[bucket]++;
+
+  if( waited > stats->m_maximum ) {
+    stats->m_maximum = waited;
+  }
+}
+
+/* Removes the element at the specified position from the sub-queue.
+ */
+
+PMQueue::QNode* PMQueue::take( QHeap* heap, ULONG pos )
+{
+  QNode* node = heap->remove( pos );
+
+  if( m_collect ) {
+    account( node, now());
+  }
+
+  return node;
+}
+
+/* Sets the priority aging policy.
+ */
+
+void PMQueue::aging( ULONG rate, ULONG ceiling )
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  ULONG current = now();
+  ULONG i, j;
+
+  if( rate && !m_aging_rate && !m_collect ) {
+    // The elements were written without the time stamps.
+    for( i = 0; i <= m_ranges; i++ ) {
+      for( j = 0; j < m_ready[i]->m_size; j++ ) {
+        m_ready[i]->m_nodes[j]->m_ready_time = current;
+      }
+    }
+  }
+
+  m_aging_rate    = rate;
+  m_aging_ceiling = ceiling;
+
+  if( rate ) {
+    age( current );
+  } else {
+    for( i = 0; i <= m_ranges; i++ ) {
+      for( j = 0; j < m_ready[i]->m_size; j++ ) {
+        m_ready[i]->m_nodes[j]->m_effective = m_ready[i]->m_nodes[j]->m_priority;
+      }
+      for( j = m_ready[i]->m_size / 2; j > 0; j-- ) {
+        m_ready[i]->sift_down( j - 1 );
+      }
+    }
+  }
+}
+
+/* Enables or disables the collection of the wait time statistics.
+ */
+
+void PMQueue::collect_stats( BOOL enable )
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  ULONG current = now();
+  ULONG i, j;
+
+  if( enable && !m_collect && !m_aging_rate ) {
+    // The elements were written without the time stamps.
+    for( i = 0; i <= m_ranges; i++ ) {
+      for( j = 0; j < m_ready[i]->m_size; j++ ) {
+        m_ready[i]->m_nodes[j]->m_ready_time = current;
+      }
+    }
+  }
+
+  m_collect = enable;
+}
+
+/* Returns the wait time statistics.
+ */
+
+void PMQueue::latency_stats( ULONG priority, latency* result )
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  QStats* stats = &m_stats[ priority < PM_QUEUE_STAT_CLASSES ?
+                            priority : PM_QUEUE_STAT_CLASSES - 1 ];
+  ULONG   seen  = 0;
+  ULONG   i;
+
+  result->count   = stats->m_count;
+  result->maximum = stats->m_maximum;
+  result->average = stats->m_count ? (ULONG)( stats->m_total / stats->m_count ) : 0;
+  result->median  = 0;
+  result->p99     = 0;
+
+  for( i = 0; i < 32 && stats->m_count; i++ )
+  {
+    // The bucket i contains the wait times less than 2^i milliseconds.
+    ULONG bound = i ? ( 1UL << i ) - 1 : 0;
+    seen += stats->m_buckets[i];
+
+    if( !result->median && seen * 2 >= stats->m_count ) {
+      result->median = bound < stats->m_maximum ? bound : stats->m_maximum;
+    }
+    if( seen * 100.0 >= stats->m_count * 99.0 ) {
+      result->p99 = bound < stats->m_maximum ? bound : stats->m_maximum;
+      break;
+    }
+  }
+}
+
+/* Purges the wait time statistics.
+ */
+
+void PMQueue::reset_stats()
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+
+  memset( m_stats, 0, sizeof( m_stats ));
+  memset( m_codes, 0, sizeof( m_codes ));
+
+  m_max_depth = m_depth;
+  m_written   = 0;
+  m_read      = 0;
+}
+
+/* Returns the queue counters.
+ */
+
+void PMQueue::counter_stats( counters* stats )
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+
+  stats->depth     = m_depth;
+  stats->max_depth = m_max_depth;
+  stats->written   = m_written;
+  stats->read      = m_read;
+}
+
+/* Returns the counters of the event codes.
+ */
+
+ULONG PMQueue::code_stats( code_counters* stats, ULONG max )
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  ULONG count = 0;
+  ULONG i;
+
+  for( i = 0; i <= PM_QUEUE_STAT_CODES && count < max; i++ ) {
+    if( m_codes[i].m_written ) {
+      stats[count].request = m_codes[i].m_request;
+      stats[count].written = m_codes[i].m_written;
+      stats[count].queued  = m_codes[i].m_queued;
+      ++count;
+    }
+  }
+
+  return count;
+}
+
+/* Writes one line of the snapshot of the statistics.
+ */
+
+static void dump_line( FILE* file, const char* line )
+{
+  if( file ) {
+    fputs( line, file );
+  } else {
+    DEBUGLOG(( "%s", line ));
+  }
+}
+
+/* Writes the snapshot of the statistics.
+ */
+
+void PMQueue::dump( const char* name, FILE* file )
+{
+  code_counters codes[PM_QUEUE_STAT_CODES+1];
+  counters      total;
+  latency       stats;
+  char          line[256];
+  ULONG         count;
+  ULONG         i;
+
+  counter_stats( &total );
+  snprintf( line, sizeof( line ), "queue %s: depth %lu, max depth %lu, written %lu, read %lu\n",
+            name, total.depth, total.max_depth, total.written, total.read );
+  dump_line( file, line );
+
+  for( i = 0; i < PM_QUEUE_STAT_CLASSES; i++ ) {
+    latency_stats( i, &stats );
+    if( stats.count ) {
+      snprintf( line, sizeof( line ), "queue %s: priority %lu%s: read %lu, wait average %lu ms, "
+                "median <= %lu ms, p99 <= %lu ms, max %lu ms\n", name, i,
+                i == PM_QUEUE_STAT_CLASSES - 1 ? "+" : "", stats.count,
+                stats.average, stats.median, stats.p99, stats.maximum );
+      dump_line( file, line );
+    }
+  }
+
+  count = code_stats( codes, PM_QUEUE_STAT_CODES + 1 );
+
+  for( i = 0; i < count; i++ ) {
+    if( codes[i].request == 0xFFFFFFFFUL ) {
+      snprintf( line, sizeof( line ), "queue %s: other requests: written %lu, queued %lu\n",
+                name, codes[i].written, codes[i].queued );
+    } else {
+      snprintf( line, sizeof( line ), "queue %s: request %lu: written %lu, queued %lu\n",
+                name, codes[i].request, codes[i].written, codes[i].queued );
+    }
+    dump_line( file, line );
+  }
+
+  if( file ) {
+    fflush( file );
+  }
+}
+
+/* Finds the most important ready element having an event code
+ * in the specified range.
+ */
+
+PMQueue::QHeap* PMQueue::find( ULONG first, ULONG last, ULONG* pos )
+{
+  QHeap* found = NULL;
+  QNode* best  = NULL;
+  ULONG  i, j;
+
+  for( i = 0; i <= m_ranges; i++ )
+  {
+    QHeap* heap = m_ready[i];
+
+    if( !heap->m_size || first > heap->m_last || last < heap->m_first ) {
+      continue;
+    }
+
+    if( first <= heap->m_first && last >= heap->m_last ) {
+      // The sub-queue is covered by the range completely.
+      if( !best || by_priority( heap->m_nodes[0], best )) {
+        best  = heap->m_nodes[0];
+        found = heap;
+        *pos  = 0;
+      }
+    } else {
+      for( j = 0; j < heap->m_size; j++ ) {
+        QNode* node = heap->m_nodes[j];
+
+        if( node->m_request >= first && node->m_request <= last ) {
+          if( !best || by_priority( node, best )) {
+            best  = node;
+            found = heap;
+            *pos  = j;
+          }
+        }
+      }
+    }
+  }
+
+  return found;
+}
+
+/* Removes the reader from the list of the waiting readers.
+ */
+
+void PMQueue::unlink( QWaiter* waiter, QWaiter* prev )
+{
+  if( prev ) {
+    prev->m_next = waiter->m_next;
+  } else {
+    m_waiters = waiter->m_next;
+  }
+  if( m_last_waiter == waiter ) {
+    m_last_waiter = prev;
+  }
+
+  waiter->m_blocked = FALSE;
+}
+
+/* Wakes the reader which waits longest for the specified event code.
+ */
+
+void PMQueue::wakeup( ULONG request )
+{
+  QWaiter* prev = NULL;
+  QWaiter* waiter;
 
-: m_frst_node( NULL ),
-  m_last_node( NULL )
-{}
+  for( waiter = m_waiters; waiter; prev = waiter, waiter = waiter->m_next ) {
+    if( request >= waiter->m_first && request <= waiter->m_last ) {
+      unlink( waiter, prev );
+      waiter->m_woken   = TRUE;
+      waiter->m_request = request;
+      waiter->m_event.post();
+      break;
+    }
+  }
+}
 
-/* Destroys the queue object.
+/* Passes the wakeup on to the next reader if a ready element
+ * having the specified event code is left.
  */
 
-PMQueue::~PMQueue() {
-  clear();
+void PMQueue::handoff( ULONG request )
+{
+  ULONG pos;
+
+  if( m_waiters && find( request, request, &pos )) {
+    wakeup( request );
+  }
+}
+
+/* Wakes all readers.
+ */
+
+void PMQueue::wakeup_all()
+{
+  QWaiter* waiter;
+
+  post_watchers();
+
+  while(( waiter = m_waiters ) != NULL ) {
+    m_waiters = waiter->m_next;
+    waiter->m_blocked = FALSE;
+    waiter->m_event.post();
+  }
+
+  m_last_waiter = NULL;
+}
+
+/* Posts the notifies registered by the watch method.
+ */
+
+void PMQueue::post_watchers()
+{
+  QWatch* watch;
+
+  for( watch = m_watchers; watch; watch = watch->m_next ) {
+    watch->m_notify->post();
+  }
 }
 
 /* Purges a queue of all its elements.
@@ -27,65 +968,365 @@ PMQueue::~PMQueue() {
 
 void PMQueue::clear()
 {
-  QNode* node;
-  QNode* next;
+  ULONG i, j;
 
   m_data_mutex.request();
 
-  for( node = m_frst_node; node; node = next ) {
-    next = node->m_next_node;
-    xfree( node );
+  for( i = 0; i <= m_ranges; i++ ) {
+    for( j = 0; j < m_ready[i]->m_size; j++ ) {
+      if( m_dispose ) {
+        m_dispose( m_ready[i]->m_nodes[j]->m_data );
+      }
+      free_node( m_ready[i]->m_nodes[j] );
+    }
+    m_ready[i]->m_size    = 0;
+    m_ready[i]->m_pending = 0;
+  }
+  for( j = 0; j < m_timers.m_size; j++ ) {
+    if( m_dispose ) {
+      m_dispose( m_timers.m_nodes[j]->m_data );
+    }
+    free_node( m_timers.m_nodes[j] );
+  }
+  for( j = 0; j <= PM_QUEUE_STAT_CODES; j++ ) {
+    m_codes[j].m_queued = 0;
   }
 
-  m_frst_node = NULL;
-  m_last_node = NULL;
-
-  m_data_ready.reset();
+  m_timers.m_size = 0;
   m_data_mutex.release();
 }
 
 /* Is a queue empty.
  */
 
-BOOL PMQueue::empty() const {
-  return !m_frst_node;
+BOOL PMQueue::empty() const
+{
+  ULONG i;
+
+  for( i = 0; i <= m_ranges; i++ ) {
+    if( m_ready[i]->m_size ) {
+      return FALSE;
+    }
+  }
+
+  return !m_timers.m_size;
 }
 
-/* Reads an element from a queue.
+/* Waits until a ready element having an event code
+ * in the specified range appears and takes it.
+ *
+ * Must be called with the queue mutex requested and
+ * returns with the queue mutex requested.
  */
 
-BOOL PMQueue::read( ULONG* request, void** data, ULONG* priority )
+ULONG PMQueue::wait( ULONG first, ULONG last, ULONG msec, QNode** node )
 {
-  for(;;) {
-    m_data_ready.wait();
-    m_data_mutex.request();
+  QWaiter* waiter  = NULL;
+  BOOL     woken   = FALSE;
+  ULONG    request = 0;
+  ULONG    start   = 0;
+  ULONG    current = 0;
+  QHeap*   heap;
+  ULONG    pos;
+  ULONG    timeout;
+  ULONG    rc;
 
-    if( m_frst_node )
-    {
-      QNode* node = m_frst_node;
+  if( msec != SEM_INDEFINITE_WAIT ) {
+    start = now();
+  }
+
+  for(;;)
+  {
+    if( m_timers.m_size || m_aging_rate ) {
+      refresh( current = now());
+    }
+    if(( heap = find( first, last, &pos )) != NULL ) {
+      *node = take( heap, pos );
+
+      // The reader woken for an element of one event code can take
+      // an element of another one, then the first element can be left
+      // to a reader waiting only for it.
+      if( woken && (*node)->m_request != request ) {
+        handoff( request );
+      }
+
+      rc = PM_QUEUE_OK;
+      break;
+    }
+    if( m_closed && !m_timers.m_size ) {
+      rc = PM_QUEUE_CLOSED;
+      break;
+    }
+    if( waiter && waiter->m_canceled ) {
+      rc = PM_QUEUE_CANCELED;
+      break;
+    }
 
-      if( request  ) { *request  = node->m_request;  }
-      if( data     ) { *data     = node->m_data;     }
-      if( priority ) { *priority = node->m_priority; }
+    if( msec == SEM_INDEFINITE_WAIT ) {
+      timeout = SEM_INDEFINITE_WAIT;
+    } else {
+      if( !m_timers.m_size ) {
+        current = now();
+      }
+      if( current - start >= msec ) {
+        rc = PM_QUEUE_TIMEOUT;
+        break;
+      }
+      timeout = msec - ( current - start );
+    }
 
-      m_frst_node = node->m_next_node;
-      xfree( node );
+    // Sleep only until the earliest pending element is due.
+    if( m_timers.m_size && m_timers.m_nodes[0]->m_due_time - current < timeout ) {
+      timeout = m_timers.m_nodes[0]->m_due_time - current;
+    }
 
-      if( m_frst_node ) {
-        m_frst_node->m_prev_node = NULL;
+    if( !waiter ) {
+      if( m_free_waiters ) {
+        waiter = m_free_waiters;
+        m_free_waiters = waiter->m_next;
       } else {
-        m_data_ready.reset();
-        m_last_node = NULL;
+        waiter = new QWaiter;
       }
-      m_data_mutex.release();
-      break;
+
+      waiter->m_first    = first;
+      waiter->m_last     = last;
+      waiter->m_canceled = FALSE;
+    }
+
+    // Every waiting reader has its own notify, which is reset while
+    // the mutex is requested, therefore no wakeup can be missed. The
+    // readers are queued in order of arrival and each written element
+    // wakes only the first of them waiting for its event code.
+    waiter->m_event.reset();
+    waiter->m_blocked = TRUE;
+    waiter->m_woken   = FALSE;
+    waiter->m_next    = NULL;
+
+    if( m_last_waiter ) {
+      m_last_waiter->m_next = waiter;
+    } else {
+      m_waiters = waiter;
+    }
+    m_last_waiter = waiter;
+
+    m_data_mutex.release();
+
+    if( timeout == SEM_INDEFINITE_WAIT ) {
+      waiter->m_event.wait();
+    } else {
+      waiter->m_event.wait( timeout );
+    }
+
+    m_data_mutex.request();
+
+    if( waiter->m_blocked ) {
+      // Woken up by timeout, the waiter is still in the list.
+      QWaiter* prev = NULL;
+
+      if( m_waiters != waiter ) {
+        for( prev = m_waiters; prev->m_next != waiter; prev = prev->m_next )
+        {}
+      }
+
+      unlink( waiter, prev );
+    }
+
+    woken   = waiter->m_woken;
+    request = waiter->m_request;
+  }
+
+  if( waiter ) {
+    waiter->m_next = m_free_waiters;
+    m_free_waiters = waiter;
+  }
+
+  return rc;
+}
+
+/* Reads an element from a queue.
+ */
+
+BOOL PMQueue::read( ULONG* request, void** data, ULONG* priority ) {
+  return read_range( 0, 0xFFFFFFFFUL, request, data, priority, SEM_INDEFINITE_WAIT ) == PM_QUEUE_OK;
+}
+
+/* Reads an element from a queue with wait timeout.
+ */
+
+ULONG PMQueue::read( ULONG* request, void** data, ULONG* priority, ULONG msec ) {
+  return read_range( 0, 0xFFFFFFFFUL, request, data, priority, msec );
+}
+
+/* Reads an element having an event code in the specified range.
+ */
+
+BOOL PMQueue::read_range( ULONG first, ULONG last, ULONG* request, void** data, ULONG* priority ) {
+  return read_range( first, last, request, data, priority, SEM_INDEFINITE_WAIT ) == PM_QUEUE_OK;
+}
+
+/* Reads an element having an event code in the specified range
+ * with wait timeout.
+ */
+
+ULONG PMQueue::read_range( ULONG first, ULONG last,
+                           ULONG* request, void** data, ULONG* priority, ULONG msec )
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  QNode* node;
+  ULONG  rc;
+
+  if(( rc = wait( first, last, msec, &node )) == PM_QUEUE_OK )
+  {
+    if( request  ) { *request  = node->m_request;  }
+    if( data     ) { *data     = node->m_data;     }
+    if( priority ) { *priority = node->m_priority; }
+
+    free_node( node );
+  }
+
+  return rc;
+}
+
+/* Reads an element storing the payload inline.
+ */
+
+ULONG PMQueue::read_payload( ULONG first, ULONG last, void* value, transfer assign,
+                             ULONG* priority, ULONG msec )
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  QNode* node;
+  ULONG  rc;
+
+  if(( rc = wait( first, last, msec, &node )) == PM_QUEUE_OK )
+  {
+    if( priority ) {
+      *priority = node->m_priority;
+    }
+
+    assign( value, node->m_data );
+    m_dispose( node->m_data );
+    free_node( node );
+  }
+
+  return rc;
+}
+
+/* Reads several elements from a queue.
+ */
+
+ULONG PMQueue::read_batch( element* elements, ULONG max )
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  ULONG  count = 0;
+  QNode* node;
+  QHeap* heap;
+  ULONG  pos;
+
+  if( max && wait( 0, 0xFFFFFFFFUL, SEM_INDEFINITE_WAIT, &node ) == PM_QUEUE_OK )
+  {
+    for(;;) {
+      elements[count].request  = node->m_request;
+      elements[count].data     = node->m_data;
+      elements[count].priority = node->m_priority;
+
+      free_node( node );
+
+      if( ++count == max || ( heap = find( 0, 0xFFFFFFFFUL, &pos )) == NULL ) {
+        break;
+      }
+
+      node = take( heap, pos );
+    }
+  }
+
+  return count;
+}
+
+/* Wakes all threads that are blocked in the read method.
+ */
+
+void PMQueue::cancel()
+{
+  QWaiter* waiter;
+
+  m_data_mutex.request();
+
+  for( waiter = m_waiters; waiter; waiter = waiter->m_next ) {
+    waiter->m_canceled = TRUE;
+  }
+
+  wakeup_all();
+  m_data_mutex.release();
+}
+
+/* Closes a queue.
+ */
+
+void PMQueue::close()
+{
+  m_data_mutex.request();
+  m_closed = TRUE;
+  wakeup_all();
+  m_data_mutex.release();
+}
+
+/* Is a queue ready to be read.
+ */
+
+BOOL PMQueue::ready( ULONG* msec )
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  ULONG current = 0;
+  ULONG pos;
+
+  if( m_timers.m_size || m_aging_rate ) {
+    refresh( current = now());
+  }
+  if( find( 0, 0xFFFFFFFFUL, &pos ) || ( m_closed && !m_timers.m_size )) {
+    return TRUE;
+  }
+
+  if( msec ) {
+    if( m_timers.m_size ) {
+      *msec = m_timers.m_nodes[0]->m_due_time - current;
     } else {
-      m_data_ready.reset();
-      m_data_mutex.release();
+      *msec = SEM_INDEFINITE_WAIT;
     }
   }
 
-  return TRUE;
+  return FALSE;
+}
+
+/* Registers a notify posted when a queue can become ready.
+ */
+
+void PMQueue::watch( PMNotify* notify )
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  QWatch* watch = new QWatch;
+
+  watch->m_notify = notify;
+  watch->m_next   = m_watchers;
+  m_watchers      = watch;
+}
+
+/* Unregisters a notify registered by the watch method.
+ */
+
+void PMQueue::unwatch( PMNotify* notify )
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  QWatch** link = &m_watchers;
+  QWatch*  watch;
+
+  while(( watch = *link ) != NULL ) {
+    if( watch->m_notify == notify ) {
+      *link = watch->m_next;
+      delete watch;
+      break;
+    }
+    link = &watch->m_next;
+  }
 }
 
 /* Examines a queue element without removing
@@ -94,18 +1335,24 @@ BOOL PMQueue::read( ULONG* request, void** data, ULONG* priority )
 
 BOOL PMQueue::peek( ULONG* request, void** data, ULONG* priority )
 {
-  m_data_mutex.request();
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  QHeap* heap;
+  ULONG  pos;
+
+  if( m_timers.m_size || m_aging_rate ) {
+    refresh( now());
+  }
 
-  if( m_frst_node )
+  if(( heap = find( 0, 0xFFFFFFFFUL, &pos )) != NULL )
   {
-    if( request  ) { *request  = m_frst_node->m_request;  }
-    if( data     ) { *data     = m_frst_node->m_data;     }
-    if( priority ) { *priority = m_frst_node->m_priority; }
+    QNode* node = heap->m_nodes[pos];
+
+    if( request  ) { *request  = node->m_request;  }
+    if( data     ) { *data     = node->m_data;     }
+    if( priority ) { *priority = node->m_priority; }
 
-    m_data_mutex.release();
     return TRUE;
   } else {
-    m_data_mutex.release();
     return FALSE;
   }
 }
@@ -116,19 +1363,20 @@ BOOL PMQueue::peek( ULONG* request, void** data, ULONG* priority )
 
 BOOL PMQueue::peek( ULONG first, ULONG last )
 {
-  BOOL rc;
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  QHeap* heap;
+  ULONG  pos;
 
-  m_data_mutex.request();
+  if( m_timers.m_size || m_aging_rate ) {
+    refresh( now());
+  }
 
-  if( m_frst_node ) {
-    rc = ( m_frst_node->m_request >= first &&
-           m_frst_node->m_request <= last  );
+  if(( heap = find( 0, 0xFFFFFFFFUL, &pos )) != NULL ) {
+    return heap->m_nodes[pos]->m_request >= first &&
+           heap->m_nodes[pos]->m_request <= last;
   } else {
-    rc = FALSE;
+    return FALSE;
   }
-
-  m_data_mutex.release();
-  return rc;
 }
 
 /* Adds an element to a queue.
@@ -136,41 +1384,121 @@ BOOL PMQueue::peek( ULONG first, ULONG last )
 
 void PMQueue::write( ULONG request, void* data, ULONG priority )
 {
-  QNode* node = (QNode*)xcalloc( sizeof( QNode ), 1 );
-  QNode* last;
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  QNode* node;
 
-  node->m_request  = request;
+  range_of( request )->reserve( 1 );
+
+  node = alloc_node( request );
   node->m_data     = data;
   node->m_priority = priority;
 
-  m_data_mutex.request();
+  put( node );
+  wakeup( request );
+  post_watchers();
+}
 
-  if( m_last_node ) {
-    for( last = m_last_node; last; last = last->m_prev_node ) {
-      if( last->m_priority >= priority ) {
-        node->m_prev_node = last;
-        node->m_next_node = last->m_next_node;
-        last->m_next_node = node;
+/* Adds an element storing the payload inline.
+ */
 
-        if( node->m_next_node ) {
-          node->m_next_node->m_prev_node = node;
-        } else {
-          m_last_node = node;
-        }
-        break;
-      }
-    }
-    if( !last ) {
-      node->m_next_node = m_frst_node;
-      m_frst_node->m_prev_node = node;
-      m_frst_node = node;
-    }
-  } else {
-    m_frst_node = node;
-    m_last_node = node;
+void PMQueue::write_payload( ULONG request, const void* value,
+                             transfer copy, ULONG priority )
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  QNode* node;
+
+  range_of( request )->reserve( 1 );
+
+  node = alloc_node( request );
+  node->m_priority = priority;
+
+  copy( node->m_data, value );
+  put( node );
+  wakeup( request );
+  post_watchers();
+}
+
+/* Adds several elements to a queue.
+ */
+
+void PMQueue::write_batch( const element* elements, ULONG count )
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  ULONG added[PM_QUEUE_MAX_RANGES+1];
+  ULONG i;
+
+  if( !count ) {
+    return;
   }
 
-  m_data_ready.post();
-  m_data_mutex.release();
+  for( i = 0; i <= m_ranges; i++ ) {
+    added[i] = 0;
+  }
+  for( i = 0; i < count; i++ ) {
+    ++added[ index_of( elements[i].request )];
+  }
+
+  // All memory is allocated before the first element is added,
+  // so the batch is either added completely or not at all.
+  for( i = 0; i <= m_ranges; i++ ) {
+    m_ready[i]->reserve( added[i] );
+  }
+
+  reserve_nodes( count );
+
+  for( i = 0; i < count; i++ )
+  {
+    QNode* node = alloc_node( elements[i].request );
+
+    node->m_data     = elements[i].data;
+    node->m_priority = elements[i].priority;
+
+    put( node );
+  }
+
+  // The readers are woken up after all elements are added, one
+  // reader for each element until there are no waiting readers.
+  for( i = 0; i < count && m_waiters; i++ ) {
+    wakeup( elements[i].request );
+  }
+
+  post_watchers();
+}
+
+/* Adds an element to a queue at the specified time.
+ */
+
+void PMQueue::write_at( ULONG request, void* data, ULONG due_time, ULONG priority )
+{
+  PMLock<PMFastMutex> lock( m_data_mutex );
+  QHeap* heap = range_of( request );
+  QNode* node;
+
+  // The room in the ready elements sub-queue is kept until the element
+  // is due, so moving it there never has to allocate memory.
+  heap->reserve( 1 );
+  m_timers.reserve( 1 );
+
+  node = alloc_node( request );
+  node->m_data     = data;
+  node->m_priority = priority;
+  node->m_due_time = due_time;
+  node->m_sequence = m_sequence++;
+
+  m_timers.push( node );
+  ++heap->m_pending;
+
+  // The readers must recalculate their timeouts only if
+  // the new element is due before all others.
+  if( m_timers.m_nodes[0] == node ) {
+    wakeup_all();
+  }
+}
+
+/* Adds an element to a queue after the specified delay.
+ */
+
+void PMQueue::write_after( ULONG request, void* data, ULONG msec, ULONG priority ) {
+  write_at( request, data, now() + msec, priority );
 }
 
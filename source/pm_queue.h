@@ -6,18 +6,114 @@
 #define PM_QUEUE_H
 
 #include <stdlib.h>
+#include <stdio.h>
 
 #include "pm_os2.h"
 #include "pm_noncopyable.h"
-#include "pm_mutex.h"
+#include "pm_fastmutex.h"
 #include "pm_notify.h"
 
+#ifndef PM_QUEUE_SLAB_SIZE
+
+/**
+ * Sets the number of queue elements allocated at once
+ * by the queue elements pool.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_QUEUE_SLAB_SIZE 64
+#endif
+
+#ifndef PM_QUEUE_POOL_LIMIT
+
+/**
+ * Sets the default maximum number of unused queue elements
+ * retained by the queue elements pool.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_QUEUE_POOL_LIMIT 1024
+#endif
+
+#ifndef PM_QUEUE_MAX_RANGES
+
+/**
+ * Sets the maximum number of the event code ranges
+ * that can be registered in one queue.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_QUEUE_MAX_RANGES 16
+#endif
+
+#ifndef PM_QUEUE_STAT_CLASSES
+
+/**
+ * Sets the number of priority classes for which the queue
+ * wait time statistics is collected. The elements having greater
+ * priorities are accounted in the last class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_QUEUE_STAT_CLASSES 8
+#endif
+
+#ifndef PM_QUEUE_STAT_CODES
+
+/**
+ * Sets the number of event codes for which the queue counters
+ * are collected separately. The other event codes are accounted
+ * together.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_QUEUE_STAT_CODES 32
+#endif
+
+#ifndef __ccdoc__
+#define PM_QUEUE_OK       0
+#define PM_QUEUE_TIMEOUT  1
+#define PM_QUEUE_CANCELED 2
+#define PM_QUEUE_CLOSED   3
+#endif
+
 /**
  * Queue class.
  *
  * A queue is ordered list of elements that is used to
  * pass information between related or unrelated processes.
  *
+ * Elements are kept in a binary heap ordered by priority, so
+ * adding and removing an element costs O(log n) regardless of
+ * the queue depth. Elements having the same priority are read
+ * in the order in which they were written.
+ *
+ * Consumers interested in one band of event codes can register this
+ * band by the <i>add_range</i> method. The elements having event codes
+ * in a registered band are kept in a separate heap, so the <i>read_range</i>
+ * method takes the most important of them in O(log n) without
+ * touching the unrelated elements.
+ *
+ * Under sustained load the strict priority order can starve the
+ * elements having low priorities. The optional aging policy set by the
+ * <i>aging</i> method raises the effective priority of the waiting
+ * elements over time.
+ *
+ * The queue elements are taken from an internal pool that grows
+ * by slabs of PM_QUEUE_SLAB_SIZE elements and reuses the elements
+ * that have been read, so the steady state operations do not call
+ * the memory allocation functions at all.
+ *
  * You can construct and destruct objects of this class.
  *
  * @author  Dmitry A.Steklenev
@@ -28,6 +124,37 @@ class PMQueue : public PMNonCopyable
 {
   public:
 
+    /** Queue element used by batch operations. */
+    struct element {
+      ULONG request;
+      void* data;
+      ULONG priority;
+    };
+
+    /** Wait time statistics of one priority class. */
+    struct latency {
+      ULONG count;    /**< Number of the read elements.              */
+      ULONG average;  /**< Average wait time in milliseconds.        */
+      ULONG maximum;  /**< Maximum wait time in milliseconds.        */
+      ULONG median;   /**< Upper bound of the median wait time.      */
+      ULONG p99;      /**< Upper bound of the 99th percentile.       */
+    };
+
+    /** Queue counters. */
+    struct counters {
+      ULONG depth;      /**< Current number of the elements.        */
+      ULONG max_depth;  /**< Maximum number of the elements.        */
+      ULONG written;    /**< Number of the written elements.        */
+      ULONG read;       /**< Number of the read elements.           */
+    };
+
+    /** Counters of one event code. */
+    struct code_counters {
+      ULONG request;    /**< Event code or 0xFFFFFFFF for the other codes. */
+      ULONG written;    /**< Number of the written elements.        */
+      ULONG queued;     /**< Current number of the elements.        */
+    };
+
     /** Creates a queue object. */
     PMQueue();
     /** Destroys the queue object. */
@@ -35,19 +162,152 @@ class PMQueue : public PMNonCopyable
 
     /** Purges a queue of all its elements. */
     void clear();
-    /** Is a queue empty. */
+    /**
+     * Is a queue empty.
+     *
+     * The elements written by the <i>write_at</i> and <i>write_after</i>
+     * methods are counted before they are due too, so the <i>read</i>
+     * method can block while the queue isn't empty.
+     */
+
     BOOL empty() const;
 
+    /**
+     * Wakes all threads that are blocked in the <i>read</i> method.
+     *
+     * The reading methods that are blocked at the moment of
+     * the call return PM_QUEUE_CANCELED. The following reads are
+     * not affected.
+     */
+
+    void cancel();
+
+    /**
+     * Closes a queue.
+     *
+     * Wakes all threads that are blocked in the <i>read</i> method.
+     * The elements remaining in the queue still can be read, after that
+     * all reading methods return PM_QUEUE_CLOSED instead of blocking.
+     */
+
+    void close();
+
+    /** Is a queue closed. */
+    BOOL closed() const;
+
+    /**
+     * Is a queue ready to be read.
+     *
+     * @param msec  If it is not NULL and there is no ready element, the
+     *              time until the earliest delayed element is due or
+     *              SEM_INDEFINITE_WAIT is stored there.
+     *
+     * @return TRUE, if a ready element is available or the queue is closed,
+     *         so a reading method doesn't block.
+     */
+
+    BOOL ready( ULONG* msec = NULL );
+
+    /**
+     * Registers a notify posted when a queue can become ready.
+     *
+     * The notify is posted when an element is added to the queue,
+     * when an element is delayed less than all others, and when the queue
+     * is canceled or closed. It is never reset by the queue.
+     */
+
+    void watch( PMNotify* notify );
+
+    /** Unregisters a notify registered by the <i>watch</i> method. */
+    void unwatch( PMNotify* notify );
+
+    /**
+     * Registers a range of event codes.
+     *
+     * The elements having event codes in the registered range are kept
+     * in a separate sub-queue. The ranges must not overlap.
+     *
+     * @param first     First event code.
+     * @param last      Last event code.
+     *
+     * @exception PMError If too many ranges are registered or the
+     *                    range overlaps an already registered one.
+     */
+
+    void add_range( ULONG first, ULONG last );
+
     /**
      * Reads an element from a queue.
      *
      * @param request   An event code that is specified by the application.
      * @param data      A pointer to the data that is being removed.
      * @param priority  The address of the element's priority.
+     *
+     * @return TRUE, if an element is read. FALSE, if the reading
+     *         is canceled or the queue is closed.
      */
 
     BOOL read( ULONG* request, void** data = NULL, ULONG* priority = NULL );
 
+    /**
+     * Reads an element from a queue with wait timeout.
+     *
+     * @param request   An event code that is specified by the application.
+     * @param data      A pointer to the data that is being removed.
+     * @param priority  The address of the element's priority.
+     * @param msec      This is the maximum amount of time the user wants
+     *                  to allow the thread to be blocked.
+     *
+     * @return The following codes are available:
+     *
+     * <dl>
+     * <dt><i>PM_QUEUE_OK      </i><dd>The element is read.
+     * <dt><i>PM_QUEUE_TIMEOUT </i><dd>The queue was empty during the specified time.
+     * <dt><i>PM_QUEUE_CANCELED</i><dd>The reading is canceled by the <i>cancel</i> method.
+     * <dt><i>PM_QUEUE_CLOSED  </i><dd>The queue is empty and closed.
+     * </dl>
+     */
+
+    ULONG read( ULONG* request, void** data, ULONG* priority, ULONG msec );
+
+    /**
+     * Reads an element having an event code in the specified range.
+     *
+     * Takes the element with the highest priority among the elements
+     * having event codes in range specified by the <i>first</i> and
+     * <i>last</i> inclusive. The other elements are left intact. If the
+     * range covers whole registered ranges only, the element is found
+     * in O(log n), otherwise the unregistered elements are scanned.
+     *
+     * @param first     First event code.
+     * @param last      Last event code.
+     * @param request   An event code that is specified by the application.
+     * @param data      A pointer to the data that is being removed.
+     * @param priority  The address of the element's priority.
+     *
+     * @return TRUE, if an element is read. FALSE, if the reading
+     *         is canceled or the queue is closed.
+     */
+
+    BOOL read_range( ULONG first, ULONG last, ULONG* request, void** data = NULL, ULONG* priority = NULL );
+
+    /**
+     * Reads an element having an event code in the specified range
+     * with wait timeout.
+     *
+     * @param first     First event code.
+     * @param last      Last event code.
+     * @param request   An event code that is specified by the application.
+     * @param data      A pointer to the data that is being removed.
+     * @param priority  The address of the element's priority.
+     * @param msec      This is the maximum amount of time the user wants
+     *                  to allow the thread to be blocked.
+     *
+     * @return The same codes as the <i>read</i> method.
+     */
+
+    ULONG read_range( ULONG first, ULONG last, ULONG* request, void** data, ULONG* priority, ULONG msec );
+
     /**
      * Examines a queue element without removing it from the queue.
      *
@@ -80,20 +340,404 @@ class PMQueue : public PMNonCopyable
 
     void write( ULONG request, void* data = NULL, ULONG priority = 0 );
 
+    /**
+     * Adds an element to a queue at the specified time.
+     *
+     * The element stays invisible to the readers until the specified
+     * time comes. The readers waiting for an element are blocked only
+     * until the earliest pending element is due, so no helper threads
+     * are needed to implement retries or delays.
+     *
+     * @param request   An event code that is specified by the application.
+     * @param data      A data to be placed into the queue.
+     * @param due_time  The value of the system millisecond counter
+     *                  (QSV_MS_COUNT) at which the element must be delivered.
+     * @param priority  The priority value of the element that is being added to the queue.
+     */
+
+    void write_at( ULONG request, void* data, ULONG due_time, ULONG priority = 0 );
+
+    /**
+     * Adds an element to a queue after the specified delay.
+     *
+     * @param request   An event code that is specified by the application.
+     * @param data      A data to be placed into the queue.
+     * @param msec      The delay in milliseconds.
+     * @param priority  The priority value of the element that is being added to the queue.
+     */
+
+    void write_after( ULONG request, void* data, ULONG msec, ULONG priority = 0 );
+
+    /**
+     * Reads several elements from a queue.
+     *
+     * Waits until the queue is not empty and then removes up to
+     * <i>max</i> elements at once under one lock.
+     *
+     * @param elements  An array receiving the removed elements.
+     * @param max       The number of elements in the array.
+     *
+     * @return The number of elements that were removed. Zero, if the
+     *         reading is canceled or the queue is closed.
+     */
+
+    ULONG read_batch( element* elements, ULONG max );
+
+    /**
+     * Adds several elements to a queue.
+     *
+     * All elements are added under one lock and the readers
+     * are notified once.
+     *
+     * @param elements  An array of the elements to be added.
+     * @param count     The number of elements in the array.
+     */
+
+    void write_batch( const element* elements, ULONG count );
+
+    /**
+     * Sets the priority aging policy.
+     *
+     * The effective priority of a waiting element is raised by one for
+     * each <i>rate</i> milliseconds of waiting, but it is never raised
+     * above the <i>ceiling</i>. The read element keeps its original priority.
+     * The effective priorities are recalculated once per <i>rate</i>
+     * milliseconds.
+     *
+     * @param rate      Number of milliseconds per one priority level.
+     *                  Zero disables the aging.
+     * @param ceiling   Maximum priority reachable by the aging.
+     */
+
+    void aging( ULONG rate, ULONG ceiling );
+
+    /**
+     * Enables or disables the collection of the statistics.
+     *
+     * The wait time statistics and the counters of the written and read
+     * elements are collected only while the collection is enabled.
+     * The current and the maximum depth of the queue are maintained
+     * always. The collection is disabled by default and can be
+     * switched at any time.
+     */
+
+    void collect_stats( BOOL enable );
+
+    /**
+     * Returns the wait time statistics.
+     *
+     * The wait time is measured from the moment an element becomes
+     * ready to be read until it is read. The percentiles are estimated
+     * by a logarithmic histogram and are accurate up to a factor of two.
+     *
+     * @param priority  The priority of the elements.
+     * @param stats     The address of the statistics to be filled.
+     */
+
+    void latency_stats( ULONG priority, latency* stats );
+
+    /** Returns the queue counters. */
+    void counter_stats( counters* stats );
+
+    /**
+     * Returns the counters of the event codes.
+     *
+     * @param stats     The address of the array to be filled.
+     * @param max       The maximum number of the array elements.
+     *
+     * @return The number of the filled array elements.
+     */
+
+    ULONG code_stats( code_counters* stats, ULONG max );
+
+    /** Purges the statistics. */
+    void reset_stats();
+
+    /**
+     * Writes the snapshot of the statistics.
+     *
+     * @param name      The name of the queue in the snapshot.
+     * @param file      The file to which the snapshot is written,
+     *                  the standard error by default. If it is NULL,
+     *                  the snapshot is written to the debug log,
+     *                  which exists in the debug builds only.
+     */
+
+    void dump( const char* name, FILE* file = stderr );
+
+    /**
+     * Sets the maximum number of unused elements retained by the pool.
+     *
+     * The unused elements above this limit are returned to the system
+     * as soon as a whole slab of the elements becomes unused.
+     */
+
+    void pool_limit( ULONG limit );
+    /** Returns the maximum number of unused elements retained by the pool. */
+    ULONG pool_limit() const;
+    /** Returns the number of elements that were taken from the pool. */
+    ULONG pool_hits() const;
+    /** Returns the number of elements that required a new slab allocation. */
+    ULONG pool_misses() const;
+
+  protected:
+
+    /** Copies or assigns the value <i>source</i> to the storage <i>target</i>. */
+    typedef void (*transfer)( void* target, const void* source );
+    /** Destroys the value stored in the <i>payload</i>. */
+    typedef void (*dispose)( void* payload );
+
+    /**
+     * Creates a queue object storing the payloads inline.
+     *
+     * Every queue element gets <i>payload_size</i> bytes of storage
+     * placed just after it in the same slab. This storage is passed
+     * to the transfer functions by the <i>write_payload</i> and
+     * <i>read_payload</i> methods and to the <i>destroy</i>
+     * function by the <i>clear</i> method.
+     */
+
+    PMQueue( ULONG payload_size, dispose destroy );
+
+    /**
+     * Adds an element storing the payload inline.
+     *
+     * The <i>copy</i> function constructs the payload from
+     * the <i>value</i> and must not throw exceptions.
+     */
+
+    void write_payload( ULONG request, const void* value,
+                        transfer copy, ULONG priority );
+
+    /**
+     * Reads an element storing the payload inline.
+     *
+     * The <i>assign</i> function assigns the payload to the <i>value</i>
+     * and must not throw exceptions. The payload is destroyed after that.
+     *
+     * @return PM_QUEUE_OK, PM_QUEUE_TIMEOUT, PM_QUEUE_CANCELED
+     *         or PM_QUEUE_CLOSED.
+     */
+
+    ULONG read_payload( ULONG first, ULONG last, void* value, transfer assign,
+                        ULONG* priority, ULONG msec );
+
   private:
 
+    struct QSlab;
+
     struct QNode {
       ULONG  m_request;
       void*  m_data;
-      QNode* m_prev_node;
-      QNode* m_next_node;
       ULONG  m_priority;
+      ULONG  m_effective;
+      ULONG  m_sequence;
+      ULONG  m_due_time;
+      ULONG  m_ready_time;
+      QSlab* m_slab;
+      QNode* m_next_free;
+    };
+
+    struct QSlab {
+      QSlab* m_prev_slab;
+      QSlab* m_next_slab;
+      QNode* m_free_node;
+      ULONG  m_free_count;
+      double m_nodes[1];
+    };
+
+    /** Returns TRUE if the node <i>a</i> must be taken before the node <i>b</i>. */
+    typedef BOOL (*precedes)( const QNode* a, const QNode* b );
+
+    struct QHeap {
+      QNode**  m_nodes;
+      ULONG    m_size;
+      ULONG    m_capacity;
+      ULONG    m_pending;
+      ULONG    m_first;
+      ULONG    m_last;
+      precedes m_precedes;
+
+      QHeap( precedes fn, ULONG first = 0, ULONG last = 0xFFFFFFFFUL );
+     ~QHeap();
+
+      /** Makes room for the specified number of elements besides the pending ones. */
+      void   reserve( ULONG count );
+      /** Adds an element to the heap. */
+      void   push( QNode* node );
+      /** Removes the element at the specified position from the heap. */
+      QNode* remove( ULONG pos );
+      /** Moves the node at the specified position toward the heap root. */
+      void   sift_up( ULONG pos );
+      /** Moves the node at the specified position toward the heap leaves. */
+      void   sift_down( ULONG pos );
     };
 
-    QNode*    m_frst_node;
-    QNode*    m_last_node;
-    PMMutex   m_data_mutex;
-    PMNotify  m_data_ready;
+    struct QWaiter {
+      ULONG    m_first;
+      ULONG    m_last;
+      BOOL     m_canceled;
+      BOOL     m_blocked;
+      BOOL     m_woken;
+      ULONG    m_request;
+      QWaiter* m_next;
+      PMNotify m_event;
+    };
+
+    struct QWatch {
+      PMNotify* m_notify;
+      QWatch*   m_next;
+    };
+
+    struct QStats {
+      ULONG  m_count;
+      ULONG  m_maximum;
+      double m_total;
+      ULONG  m_buckets[32];
+    };
+
+    struct QCode {
+      ULONG  m_request;
+      ULONG  m_written;
+      ULONG  m_queued;
+    };
+
+    QHeap*    m_ready[PM_QUEUE_MAX_RANGES+1];
+    ULONG     m_ranges;
+    QHeap     m_timers;
+    ULONG     m_sequence;
+    BOOL      m_closed;
+    QWaiter*  m_waiters;
+    QWaiter*  m_last_waiter;
+    QWaiter*  m_free_waiters;
+    QWatch*   m_watchers;
+    QSlab*    m_free_slab;
+    ULONG     m_free_count;
+    ULONG     m_pool_limit;
+    ULONG     m_pool_hits;
+    ULONG     m_pool_misses;
+    ULONG     m_aging_rate;
+    ULONG     m_aging_ceiling;
+    ULONG     m_aged_at;
+    BOOL      m_collect;
+    QStats    m_stats[PM_QUEUE_STAT_CLASSES];
+    QCode     m_codes[PM_QUEUE_STAT_CODES+1];
+    ULONG     m_depth;
+    ULONG     m_max_depth;
+    ULONG     m_written;
+    ULONG     m_read;
+    ULONG     m_node_size;
+    ULONG     m_payload_size;
+    dispose   m_dispose;
+    PMFastMutex m_data_mutex;
+
+    /** Returns the specified element of the slab. */
+    QNode* node_of( QSlab* slab, ULONG i ) const;
+    /** Adds a slab of unused elements to the pool. */
+    void grow();
+    /** Makes sure the pool contains the specified number of unused elements. */
+    void reserve_nodes( ULONG count );
+    /** Takes an unused element from the pool. */
+    QNode* alloc_node( ULONG request );
+    /** Returns an element to the pool. */
+    void free_node( QNode* node );
+    /** Returns the sub-queue intended for the specified event code. */
+    QHeap* range_of( ULONG request );
+    /** Returns the index of the sub-queue intended for the specified event code. */
+    ULONG index_of( ULONG request ) const;
+    /** Adds an element to the ready elements sub-queues. */
+    void put( QNode* node );
+    /** Moves the elements whose time has come to the ready elements sub-queues. */
+    void promote( ULONG now );
+    /** Recalculates the effective priorities of the ready elements. */
+    void age( ULONG now );
+    /** Promotes the pending elements and ages the ready elements if it is needed. */
+    void refresh( ULONG now );
+    /** Returns the counters of the specified event code. */
+    QCode* code_of( ULONG request );
+    /** Accounts the wait time of the read element. */
+    void account( const QNode* node, ULONG now );
+    /** Removes the element at the specified position from the sub-queue. */
+    QNode* take( QHeap* heap, ULONG pos );
+
+    /**
+     * Finds the most important ready element having an event code
+     * in the specified range.
+     *
+     * @return The sub-queue containing the found element or NULL.
+     */
+
+    QHeap* find( ULONG first, ULONG last, ULONG* pos );
+
+    /**
+     * Waits until a ready element having an event code
+     * in the specified range appears and takes it.
+     *
+     * Must be called with the queue mutex requested and
+     * returns with the queue mutex requested.
+     */
+
+    ULONG wait( ULONG first, ULONG last, ULONG msec, QNode** node );
+
+    /** Removes the reader from the list of the waiting readers. */
+    void unlink( QWaiter* waiter, QWaiter* prev );
+    /** Wakes the reader which waits longest for the specified event code. */
+    void wakeup( ULONG request );
+    /** Passes the wakeup on to the next reader if a ready element having the event code is left. */
+    void handoff( ULONG request );
+    /** Wakes all readers. */
+    void wakeup_all();
+    /** Posts the notifies registered by the watch method. */
+    void post_watchers();
+
+    /** Returns TRUE if the node <i>a</i> must be read before the node <i>b</i>. */
+    static BOOL by_priority( const QNode* a, const QNode* b );
+    /** Returns TRUE if the node <i>a</i> is due before the node <i>b</i>. */
+    static BOOL by_due_time( const QNode* a, const QNode* b );
+    /** Returns the value of the system millisecond counter. */
+    static ULONG now();
 };
 
+/* Returns the specified element of the slab.
+ */
+
+inline PMQueue::QNode* PMQueue::node_of( QSlab* slab, ULONG i ) const {
+  return (QNode*)((char*)slab->m_nodes + i * m_node_size );
+}
+
+/* Returns the sub-queue intended for the specified event code.
+ */
+
+inline PMQueue::QHeap* PMQueue::range_of( ULONG request ) {
+  return m_ready[ index_of( request )];
+}
+
+/* Is a queue closed.
+ */
+
+inline BOOL PMQueue::closed() const {
+  return m_closed;
+}
+
+/* Returns the maximum number of unused elements retained by the pool.
+ */
+
+inline ULONG PMQueue::pool_limit() const {
+  return m_pool_limit;
+}
+
+/* Returns the number of elements that were taken from the pool.
+ */
+
+inline ULONG PMQueue::pool_hits() const {
+  return m_pool_hits;
+}
+
+/* Returns the number of elements that required a new slab allocation.
+ */
+
+inline ULONG PMQueue::pool_misses() const {
+  return m_pool_misses;
+}
+
 #endif
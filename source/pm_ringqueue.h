@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_RINGQUEUE_H
+#define PM_RINGQUEUE_H
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_notify.h"
+#include "pm_smp.h"
+
+/**
+ * Bounded single producer single consumer queue class.
+ *
+ * The PMRingQueue class template is a fixed capacity ring buffer
+ * intended to pass elements from one producer thread to one
+ * consumer thread. When the buffer is full the producer is
+ * slowed down until the consumer reads some elements, so a fast
+ * producer can't grow memory without bound.
+ *
+ * The head and the tail indices are placed into separate cache
+ * lines and neither side takes any lock. A notify is posted only
+ * when the opposite side is really blocked.
+ *
+ * Methods <i>push</i> must be called from one producer thread only
+ * and methods <i>pop</i> must be called from one consumer thread only.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+template <class T> class PMRingQueue : public PMNonCopyable
+{
+  public:
+
+    /**
+     * Creates a queue object.
+     *
+     * @param capacity  The maximum number of elements in the queue.
+     *                  It is rounded up to the nearest power of two.
+     *
+     * @exception bad_alloc If the implementation cannot allocate memory storage.
+     */
+
+    PMRingQueue( ULONG capacity );
+    /** Destroys the queue object. */
+   ~PMRingQueue();
+
+    /** Returns the maximum number of elements in the queue. */
+    ULONG capacity() const { return m_mask + 1; }
+    /** Returns the current number of elements in the queue. */
+    ULONG size() const { return m_head - m_tail; }
+    /** Is a queue empty. */
+    BOOL empty() const { return m_head == m_tail; }
+
+    /**
+     * Adds an element to a queue.
+     *
+     * Blocks the calling thread indefinitely while the queue is full.
+     */
+
+    void push( const T& value ) {
+      push( value, SEM_INDEFINITE_WAIT );
+    }
+
+    /**
+     * Adds an element to a queue with wait timeout.
+     *
+     * @param  msec   This is the maximum amount of time the
+     *                user wants to allow the thread to be blocked.
+     *
+     * @return TRUE, if the element is added.
+     */
+
+    BOOL push( const T& value, ULONG msec );
+
+    /**
+     * Adds an element to a queue if it is not full.
+     *
+     * @return TRUE, if the element is added.
+     */
+
+    BOOL try_push( const T& value ) {
+      return push( value, SEM_IMMEDIATE_RETURN );
+    }
+
+    /**
+     * Reads an element from a queue.
+     *
+     * Blocks the calling thread indefinitely while the queue is empty.
+     */
+
+    void pop( T& value ) {
+      pop( value, SEM_INDEFINITE_WAIT );
+    }
+
+    /**
+     * Reads an element from a queue with wait timeout.
+     *
+     * @param  msec   This is the maximum amount of time the
+     *                user wants to allow the thread to be blocked.
+     *
+     * @return TRUE, if the element is read.
+     */
+
+    BOOL pop( T& value, ULONG msec );
+
+    /**
+     * Reads an element from a queue if it is not empty.
+     *
+     * @return TRUE, if the element is read.
+     */
+
+    BOOL try_pop( T& value ) {
+      return pop( value, SEM_IMMEDIATE_RETURN );
+    }
+
+  private:
+
+    T*             m_data;
+    ULONG          m_mask;
+    PMNotify       m_not_full;
+    PMNotify       m_not_empty;
+
+    char           m_pad1[PM_CACHE_LINE_SIZE];
+    volatile ULONG m_head;
+    volatile ULONG m_producer_waits;
+    char           m_pad2[PM_CACHE_LINE_SIZE - 2 * sizeof( ULONG )];
+    volatile ULONG m_tail;
+    volatile ULONG m_consumer_waits;
+    char           m_pad3[PM_CACHE_LINE_SIZE - 2 * sizeof( ULONG )];
+
+    /**
+     * Waits the notify until the specified deadline.
+     * @return FALSE, if the deadline is reached.
+     */
+
+    static BOOL wait( PMNotify& notify, ULONG msec, ULONG start );
+};
+
+/* Creates a queue object.
+ */
+
+template <class T>
+PMRingQueue<T>::PMRingQueue( ULONG capacity )
+
+: m_head( 0 ),
+  m_tail( 0 ),
+  m_producer_waits( FALSE ),
+  m_consumer_waits( FALSE )
+{
+  for( m_mask = 1; m_mask < capacity; m_mask <<= 1 )
+  {}
+
+  m_data = new T[m_mask--];
+}
+
+/* Destroys the queue object.
+ */
+
+template <class T>
+PMRingQueue<T>::~PMRingQueue() {
+  delete[] m_data;
+}
+
+/* Waits the notify until the specified deadline.
+ */
+
+template <class T>
+BOOL PMRingQueue<T>::wait( PMNotify& notify, ULONG msec, ULONG start )
+{
+  ULONG now;
+
+  if( msec == SEM_INDEFINITE_WAIT ) {
+    return notify.wait();
+  }
+
+  DosQuerySysInfo( QSV_MS_COUNT, QSV_MS_COUNT, &now, sizeof( now ));
+
+  if( now - start >= msec ) {
+    return FALSE;
+  }
+
+  notify.wait( msec - ( now - start ));
+  return TRUE;
+}
+
+/* Adds an element to a queue with wait timeout.
+ */
+
+template <class T>
+BOOL PMRingQueue<T>::push( const T& value, ULONG msec )
+{
+  ULONG head  = m_head;
+  ULONG start = 0;
+
+  if( msec != SEM_INDEFINITE_WAIT && msec != SEM_IMMEDIATE_RETURN ) {
+    DosQuerySysInfo( QSV_MS_COUNT, QSV_MS_COUNT, &start, sizeof( start ));
+  }
+
+  while( head - m_tail > m_mask )
+  {
+    if( msec == SEM_IMMEDIATE_RETURN ) {
+      return FALSE;
+    }
+
+    // The notify must be reset before the flag is raised and the tail is
+    // examined again, otherwise a post from the consumer can be lost.
+    m_not_full.reset();
+    xchg( (ULONG&)m_producer_waits, (ULONG)TRUE );
+
+    if( head - m_tail > m_mask && !wait( m_not_full, msec, start )) {
+      xchg( (ULONG&)m_producer_waits, (ULONG)FALSE );
+      return FALSE;
+    }
+
+    xchg( (ULONG&)m_producer_waits, (ULONG)FALSE );
+  }
+
+  m_data[ head & m_mask ] = value;
+  xchg( (ULONG&)m_head, head + 1 );
+
+  if( m_consumer_waits ) {
+    m_not_empty.post();
+  }
+
+  return TRUE;
+}
+
+/* Reads an element from a queue with wait timeout.
+ */
+
+template <class T>
+BOOL PMRingQueue<T>::pop( T& value, ULONG msec )
+{
+  ULONG tail  = m_tail;
+  ULONG start = 0;
+
+  if( msec != SEM_INDEFINITE_WAIT && msec != SEM_IMMEDIATE_RETURN ) {
+    DosQuerySysInfo( QSV_MS_COUNT, QSV_MS_COUNT, &start, sizeof( start ));
+  }
+
+  while( m_head == tail )
+  {
+    if( msec == SEM_IMMEDIATE_RETURN ) {
+      return FALSE;
+    }
+
+    // The notify must be reset before the flag is raised and the head is
+    // examined again, otherwise a post from the producer can be lost.
+    m_not_empty.reset();
+    xchg( (ULONG&)m_consumer_waits, (ULONG)TRUE );
+
+    if( m_head == tail && !wait( m_not_empty, msec, start )) {
+      xchg( (ULONG&)m_consumer_waits, (ULONG)FALSE );
+      return FALSE;
+    }
+
+    xchg( (ULONG&)m_consumer_waits, (ULONG)FALSE );
+  }
+
+  value = m_data[ tail & m_mask ];
+  xchg( (ULONG&)m_tail, tail + 1 );
+
+  if( m_producer_waits ) {
+    m_not_full.post();
+  }
+
+  return TRUE;
+}
+
+#endif
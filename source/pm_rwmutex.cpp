@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#include "pm_rwmutex.h"
+#include "pm_smp.h"
+
+#define PM_RWMUTEX_WRITER 0x80000000UL
+
+/* Constructs the reader-writer mutual exclusion object.
+ */
+
+PMRWMutex::PMRWMutex()
+: m_state( 0 )
+{}
+
+/* Request exclusive access to resource.
+ */
+
+BOOL PMRWMutex::request()
+{
+  ULONG state;
+
+  m_writers.request();
+
+  // The notify is reset only by the writer before it stops the new
+  // readers. Any reader which finds the writer flag set then waits
+  // for the post issued by this writer when it leaves.
+  m_writer_gone.reset();
+
+  // Stops the new readers.
+  do {
+    state = m_state;
+  } while( cmpxchg((ULONG&)m_state, state | PM_RWMUTEX_WRITER, state ) != state );
+
+  // The notify is reset before the number of readers is checked,
+  // therefore the post issued by the last reader can't be lost.
+  for(;;) {
+    m_readers_gone.reset();
+    if( m_state == PM_RWMUTEX_WRITER ) {
+      return TRUE;
+    }
+    m_readers_gone.wait();
+  }
+}
+
+/* Relinquishes exclusive access to resource.
+ */
+
+BOOL PMRWMutex::release()
+{
+  xchg((ULONG&)m_state, 0UL );
+  m_writer_gone.post();
+  m_writers.release();
+  return TRUE;
+}
+
+/* Request shared access to resource.
+ */
+
+BOOL PMRWMutex::request_shared()
+{
+  for(;;)
+  {
+    ULONG state = m_state;
+
+    if(!( state & PM_RWMUTEX_WRITER )) {
+      if( cmpxchg((ULONG&)m_state, state + 1, state ) == state ) {
+        return TRUE;
+      }
+    } else {
+      m_writer_gone.wait();
+    }
+  }
+}
+
+/* Relinquishes shared access to resource.
+ */
+
+BOOL PMRWMutex::release_shared()
+{
+  if( xadd((ULONG&)m_state, (ULONG)-1 ) == PM_RWMUTEX_WRITER + 1 ) {
+    // The last reader wakes up the waiting writer.
+    m_readers_gone.post();
+  }
+
+  return TRUE;
+}
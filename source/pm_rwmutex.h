@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_RWMUTEX_H
+#define PM_RWMUTEX_H
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_fastmutex.h"
+#include "pm_notify.h"
+
+/**
+ * Serialize access to resources read by many threads.
+ *
+ * The PMRWMutex class lets any number of threads read a resource
+ * at the same time while the threads modifying the resource get
+ * exclusive access. A shared access to the free resource is taken
+ * by one atomic operation without calling the kernel. A thread
+ * requesting the exclusive access stops the new readers and waits
+ * until the current ones are gone, so the writers are never starved.
+ *
+ * Neither access is recursive. The methods <i>request</i> and
+ * <i>release</i> take the exclusive access and can be used
+ * together with the PMLock class, the methods <i>request_shared</i>
+ * and <i>release_shared</i> take the shared access and can
+ * be used together with the PMSharedLock class.
+ *
+ * None of the functions in this class throws exceptions because
+ * an exception probably has been thrown already or is about
+ * to be thrown.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+class PMRWMutex : public PMNonCopyable
+{
+  public:
+    /** Constructs the reader-writer mutual exclusion object. */
+    PMRWMutex();
+
+    /**
+     * Request exclusive access to resource.
+     *
+     * Blocks the calling thread indefinitely.
+     *
+     * @return TRUE, if ownership established.
+     */
+
+    BOOL request();
+
+    /**
+     * Relinquishes exclusive access to resource.
+     *
+     * @return TRUE, if ownership relinquished.
+     */
+
+    BOOL release();
+
+    /**
+     * Request shared access to resource.
+     *
+     * Blocks the calling thread indefinitely.
+     *
+     * @return TRUE, if access established.
+     */
+
+    BOOL request_shared();
+
+    /**
+     * Relinquishes shared access to resource.
+     *
+     * @return TRUE, if access relinquished.
+     */
+
+    BOOL release_shared();
+
+  private:
+
+    // The high bit is set while a writer owns or waits for the
+    // resource, the other bits contain the number of readers.
+    volatile ULONG m_state;
+    PMFastMutex    m_writers;
+    PMNotify       m_readers_gone;
+    PMNotify       m_writer_gone;
+};
+
+/**
+ * Locks a resource for shared access for a specified period of time.
+ *
+ * A special class PMSharedLock is a counterpart of the PMLock class
+ * for a class providing methods <i>request_shared</i> and
+ * <i>release_shared</i>.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+template <class T> class PMSharedLock : public PMNonCopyable
+{
+  public:
+
+    /**
+     * Constructs the lock and request shared access to resource.
+     *
+     * Blocks the calling thread indefinitely.
+     */
+
+    PMSharedLock( T& res ) : m_res( res ) {
+      m_res.request_shared();
+    }
+
+    /** Destroys the lock and relinquishes shared access to resource. */
+   ~PMSharedLock() {
+      m_res.release_shared();
+    }
+
+  private:
+    T& m_res;
+};
+
+#endif
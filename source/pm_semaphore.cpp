@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#include "pm_semaphore.h"
+#include "pm_lock.h"
+
+/* Constructs the semaphore having the specified count.
+ */
+
+PMSemaphore::PMSemaphore( ULONG count )
+
+: m_count  ( count ),
+  m_waiting( 0     )
+{}
+
+/* Takes one unit of the count.
+ */
+
+BOOL PMSemaphore::acquire() {
+  return acquire( SEM_INDEFINITE_WAIT );
+}
+
+/* Takes one unit of the count with wait timeout.
+ */
+
+BOOL PMSemaphore::acquire( unsigned long msec )
+{
+  PMLock<PMFastMutex> lock( m_mutex );
+  ULONG start = 0;
+  ULONG current;
+
+  if( msec != SEM_INDEFINITE_WAIT ) {
+    DosQuerySysInfo( QSV_MS_COUNT, QSV_MS_COUNT, &start, sizeof( start ));
+  }
+
+  while( !m_count )
+  {
+    ++m_waiting;
+
+    if( msec == SEM_INDEFINITE_WAIT ) {
+      m_available.wait( m_mutex );
+    } else {
+      DosQuerySysInfo( QSV_MS_COUNT, QSV_MS_COUNT, &current, sizeof( current ));
+
+      if( current - start >= msec ) {
+        --m_waiting;
+        return FALSE;
+      }
+
+      m_available.wait( m_mutex, msec - ( current - start ));
+    }
+
+    --m_waiting;
+  }
+
+  --m_count;
+  return TRUE;
+}
+
+/* Takes one unit of the count if it is available.
+ */
+
+BOOL PMSemaphore::try_acquire()
+{
+  if( !m_count ) {
+    return FALSE;
+  }
+
+  PMLock<PMFastMutex> lock( m_mutex );
+
+  if( !m_count ) {
+    return FALSE;
+  }
+
+  --m_count;
+  return TRUE;
+}
+
+/* Adds the specified number of units to the count.
+ */
+
+BOOL PMSemaphore::release( ULONG count )
+{
+  PMLock<PMFastMutex> lock( m_mutex );
+  ULONG i;
+
+  m_count += count;
+
+  // Each unit wakes up no more than one waiting thread.
+  for( i = 0; i < count && i < m_waiting; i++ ) {
+    if( !m_available.signal()) {
+      break;
+    }
+  }
+
+  return TRUE;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_SEMAPHORE_H
+#define PM_SEMAPHORE_H
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_fastmutex.h"
+#include "pm_condition.h"
+
+/**
+ * Counting semaphore.
+ *
+ * The PMSemaphore class limits the number of threads accessing
+ * a resource or counts the available items. The <i>acquire</i>
+ * method takes one unit of the count and blocks the calling thread
+ * only while the count is zero. The <i>release</i> method adds
+ * units to the count and wakes up at most that many waiting threads.
+ *
+ * None of the functions in this class throws exceptions because
+ * an exception probably has been thrown already or is about
+ * to be thrown.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+class PMSemaphore : public PMNonCopyable
+{
+  public:
+    /** Constructs the semaphore having the specified count. */
+    PMSemaphore( ULONG count = 0 );
+
+    /**
+     * Takes one unit of the count.
+     *
+     * Blocks the calling thread indefinitely while the count is zero.
+     *
+     * @return TRUE, if the unit is taken.
+     */
+
+    BOOL acquire();
+
+    /**
+     * Takes one unit of the count with wait timeout.
+     *
+     * @param  msec   This is the maximum amount of time the
+     *                user wants to allow the thread to be blocked.
+     *
+     * @return TRUE, if the unit is taken.
+     */
+
+    BOOL acquire( unsigned long msec );
+
+    /**
+     * Takes one unit of the count if it is available.
+     *
+     * Never blocks the calling thread.
+     *
+     * @return TRUE, if the unit is taken.
+     */
+
+    BOOL try_acquire();
+
+    /**
+     * Adds the specified number of units to the count.
+     *
+     * @return TRUE, if the count is increased.
+     */
+
+    BOOL release( ULONG count = 1 );
+
+    /** Returns the current count. */
+    ULONG count() const { return m_count; }
+
+  private:
+    volatile ULONG m_count;
+    ULONG          m_waiting;
+    PMFastMutex    m_mutex;
+    PMCondition    m_available;
+};
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_SEQLOCK_H
+#define PM_SEQLOCK_H
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_fastmutex.h"
+#include "pm_lock.h"
+#include "pm_atomic.h"
+#include "pm_smp.h"
+
+/**
+ * Sequence lock.
+ *
+ * The PMSeqLock class template keeps a small value read by many
+ * threads and changed rarely. A reader copies the value and checks
+ * that the sequence number wasn't changed by a writer meanwhile,
+ * otherwise it copies the value again. The readers never block and
+ * never write to the memory shared with other threads, so they don't
+ * slow down each other. The writers are serialized by a mutex.
+ *
+ * The type T must be a plain data type: it is copied while a writer
+ * can change it, and the copy is used only if it is consistent.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+template <class T> class PMSeqLock : public PMNonCopyable
+{
+  public:
+
+    /** Constructs the sequence lock keeping the specified value. */
+    PMSeqLock( const T& value = T()) : m_sequence( 0 ), m_value( value ) {}
+
+    /** Returns a consistent copy of the value. */
+    T read() const;
+
+    /** Replaces the value. */
+    void write( const T& value );
+
+  private:
+    PMAtomic<ULONG> m_sequence;
+    T               m_value;
+    PMFastMutex     m_writers;
+};
+
+/* Returns a consistent copy of the value.
+ */
+
+template <class T>
+T PMSeqLock<T>::read() const
+{
+  ULONG sequence;
+  T     value;
+
+  for(;;)
+  {
+    // The sequence number is odd while a writer changes the value.
+    if(( sequence = m_sequence.load( PM_ACQUIRE )) & 1 ) {
+      spin_pause();
+      continue;
+    }
+
+    value = m_value;
+    atomic_fence( PM_ACQUIRE );
+
+    if( m_sequence.load( PM_RELAXED ) == sequence ) {
+      return value;
+    }
+  }
+}
+
+/* Replaces the value.
+ */
+
+template <class T>
+void PMSeqLock<T>::write( const T& value )
+{
+  PMLock<PMFastMutex> lock( m_writers );
+  ULONG sequence = m_sequence.load( PM_RELAXED );
+
+  m_sequence.store( sequence + 1, PM_RELAXED );
+  atomic_fence( PM_RELEASE );
+  m_value = value;
+  m_sequence.store( sequence + 2 );
+}
+
+#endif
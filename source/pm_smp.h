@@ -7,14 +7,120 @@
 
 #include "pm_os2.h"
 
+#ifndef PM_CACHE_LINE_SIZE
+
+/**
+ * Sets the size of the processor cache line.
+ *
+ * Data modified by different threads must be separated
+ * at least by this number of bytes to avoid false sharing.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_CACHE_LINE_SIZE 64
+#endif
+
+#ifndef PM_SPIN_YIELDS
+
+/**
+ * Sets the number of the times a thread waiting for a spin lock
+ * yields the processor before it starts to sleep.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_SPIN_YIELDS 16
+#endif
+
+#if defined( __GNUC__ )
+
+inline unsigned int xchg( unsigned int* p, unsigned int x ) {
+  return __atomic_exchange_n( p, x, __ATOMIC_SEQ_CST );
+}
+inline unsigned int xadd( unsigned int* p, unsigned int x ) {
+  return __atomic_fetch_add( p, x, __ATOMIC_SEQ_CST );
+}
+inline unsigned int cmpxchg( unsigned int* p, unsigned int x, unsigned int c ) {
+  __atomic_compare_exchange_n( p, &c, x, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST );
+  return c;
+}
+inline void spin_pause( void ) {
+  #if defined( __i386__ ) || defined( __x86_64__ )
+  __builtin_ia32_pause();
+  #endif
+}
+
+/** Exchanges the contents of the destination and source operands. */
+template <class T> T xchg( T& p, T x ) {
+  return __atomic_exchange_n( &p, x, __ATOMIC_SEQ_CST );
+}
+
+/** Exchanges and adds the source operand to the destination operand. */
+template <class T> T xadd( T& p, T x ) {
+  return __atomic_fetch_add( &p, x, __ATOMIC_SEQ_CST );
+}
+
+/**
+ * Compares and exchanges the destination operand.
+ *
+ * Stores <i>x</i> into <i>p</i> if the current value of <i>p</i> is
+ * equal to <i>c</i>. Returns the previous value of <i>p</i>.
+ */
+
+template <class T> T cmpxchg( T& p, T x, T c ) {
+  __atomic_compare_exchange_n( &p, &c, x, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST );
+  return c;
+}
+
+#else
+
 extern  unsigned int xchg( unsigned int* p, unsigned int x );
 #pragma aux xchg = "xchg [esi],eax" parm [ESI][EAX] value [EAX];
 extern  unsigned int xadd( unsigned int* p, unsigned int x );
 #pragma aux xadd = "lock xadd [esi],eax" parm [ESI][EAX] value [EAX];
+extern  unsigned int cmpxchg( unsigned int* p, unsigned int x, unsigned int c );
+#pragma aux cmpxchg = "lock cmpxchg [esi],edx" parm [ESI][EDX][EAX] value [EAX];
+extern  void spin_pause( void );
+#pragma aux spin_pause = 0xF3 0x90;
 
 /** Exchanges the contents of the destination and source operands. */
 template <class T> T xchg( T& p, T x ) {
   return (T)xchg((unsigned int*)&p, (unsigned int)x );
 }
 
+/** Exchanges and adds the source operand to the destination operand. */
+template <class T> T xadd( T& p, T x ) {
+  return (T)xadd((unsigned int*)&p, (unsigned int)x );
+}
+
+/**
+ * Compares and exchanges the destination operand.
+ *
+ * Stores <i>x</i> into <i>p</i> if the current value of <i>p</i> is
+ * equal to <i>c</i>. Returns the previous value of <i>p</i>.
+ */
+
+template <class T> T cmpxchg( T& p, T x, T c ) {
+  return (T)cmpxchg((unsigned int*)&p, (unsigned int)x, (unsigned int)c );
+}
+
+#endif
+
+/**
+ * Lets the owner of a busy spin lock run.
+ *
+ * DosSleep(0) yields the processor only to the threads of the same
+ * priority, so after PM_SPIN_YIELDS attempts the waiting thread sleeps,
+ * which lets the owner of a lower priority release the lock.
+ *
+ * @param count  The number of the previous attempts, is incremented.
+ */
+
+inline void spin_yield( ULONG& count ) {
+  DosSleep( ++count < PM_SPIN_YIELDS ? 0 : 1 );
+}
+
 #endif
@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#include "pm_snapshot.h"
+#include "pm_fastmutex.h"
+#include "pm_lock.h"
+
+char               PMEpoch::m_slots[( QSLOTS + 1 ) * PM_CACHE_LINE_SIZE];
+PMAtomic<ULONG>    PMEpoch::m_epoch;
+PMEpoch::QRetired* PMEpoch::m_retired = NULL;
+ULONG              PMEpoch::m_count   = 0;
+
+static PMFastMutex retired_mutex;
+
+/* Returns the first of the aligned slots.
+ */
+
+PMEpoch::QSlot* PMEpoch::slots() {
+  return (QSlot*)(((ULONG)m_slots + PM_CACHE_LINE_SIZE - 1 ) & ~( PM_CACHE_LINE_SIZE - 1UL ));
+}
+
+/* Returns the slot of the thread, claims a spare one if requested.
+ */
+
+PMEpoch::QSlot* PMEpoch::slot( TID tid, BOOL claim )
+{
+  QSlot* first = slots();
+  ULONG  i;
+
+  if( tid < PM_MAX_THREADS ) {
+    return &first[tid];
+  }
+
+  // The spare slot claimed by the outermost enter call.
+  for( i = PM_MAX_THREADS; i < QSLOTS; i++ ) {
+    if( first[i].m_owner == tid ) {
+      return &first[i];
+    }
+  }
+
+  if( !claim ) {
+    return NULL;
+  }
+
+  for(;;)
+  {
+    for( i = PM_MAX_THREADS; i < QSLOTS; i++ ) {
+      if( !first[i].m_owner && cmpxchg((ULONG&)first[i].m_owner, (ULONG)tid, 0UL ) == 0 ) {
+        return &first[i];
+      }
+    }
+
+    // All spare slots are claimed, one of them is freed
+    // as soon as its thread leaves the shared data.
+    DosSleep( 1 );
+  }
+}
+
+/* Starts an access to the shared data.
+ */
+
+void PMEpoch::enter()
+{
+  QSlot* slot = PMEpoch::slot( PMGUI::tid(), TRUE );
+
+  // The announcement must be visible before the shared data
+  // are read, therefore it is stored by a locked instruction.
+  if( !slot->m_nesting++ ) {
+    slot->m_epoch.store(( m_epoch.load( PM_RELAXED ) << 1 ) | 1 );
+  }
+}
+
+/* Ends an access to the shared data.
+ */
+
+void PMEpoch::leave()
+{
+  QSlot* slot = PMEpoch::slot( PMGUI::tid(), FALSE );
+
+  if( !--slot->m_nesting ) {
+    slot->m_epoch.store( 0, PM_RELEASE );
+
+    // Frees the spare slot.
+    if( slot->m_owner ) {
+      xchg((ULONG&)slot->m_owner, 0UL );
+    }
+  }
+}
+
+/* Advances the epoch if all reading threads have seen it.
+ *
+ * Must be called with the mutex of the retired objects requested.
+ */
+
+BOOL PMEpoch::advance()
+{
+  QSlot* first   = slots();
+  ULONG  current = m_epoch.load( PM_RELAXED );
+  ULONG  i;
+
+  for( i = 0; i < QSLOTS; i++ )
+  {
+    ULONG epoch = first[i].m_epoch.load();
+
+    if( epoch && epoch >> 1 != ( current & 0x7FFFFFFFUL )) {
+      return FALSE;
+    }
+  }
+
+  m_epoch.store( current + 1 );
+  return TRUE;
+}
+
+/* Destroys the retired objects which can't be accessed.
+ */
+
+ULONG PMEpoch::reclaim()
+{
+  QRetired*  ready = NULL;
+  QRetired*  next;
+  QRetired** link;
+  ULONG      count;
+
+  {
+    PMLock<PMFastMutex> lock( retired_mutex );
+    ULONG current;
+
+    // The epoch is advanced once more if the readers have seen
+    // the new one already, usually if none of them is active, so
+    // the objects retired just before are destroyed at once.
+    if( advance()) {
+      advance();
+    }
+    current = m_epoch.load( PM_RELAXED );
+
+    // An object is retired with the epoch current at that moment and
+    // can be accessed only by the readers of this or previous epoch.
+    for( link = &m_retired; *link; ) {
+      if( current - (*link)->m_epoch >= 2 ) {
+        next = (*link)->m_next;
+        (*link)->m_next = ready;
+        ready = *link;
+        *link = next;
+        --m_count;
+      } else {
+        link = &(*link)->m_next;
+      }
+    }
+
+    count = m_count;
+  }
+
+  for( ; ready; ready = next ) {
+    next = ready->m_next;
+    ready->m_fn( ready->m_p );
+    delete ready;
+  }
+
+  return count;
+}
+
+/* Retires an object removed from the shared data.
+ */
+
+void PMEpoch::retire( void* p, destroy fn )
+{
+  QRetired* retired = new QRetired;
+
+  retired->m_p  = p;
+  retired->m_fn = fn;
+
+  {
+    PMLock<PMFastMutex> lock( retired_mutex );
+
+    retired->m_epoch = m_epoch.load( PM_RELAXED );
+    retired->m_next  = m_retired;
+    m_retired = retired;
+    ++m_count;
+  }
+
+  reclaim();
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_SNAPSHOT_H
+#define PM_SNAPSHOT_H
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_atomic.h"
+#include "pm_smp.h"
+#include "pm_gui.h"
+
+#ifndef PM_EPOCH_SPARE_SLOTS
+
+/**
+ * Sets the number of the spare reader slots of the PMEpoch class.
+ *
+ * The threads having the identifiers above PM_MAX_THREADS claim
+ * a spare slot while they access the shared data. If all of them
+ * are claimed, such thread waits until one of them is freed.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_EPOCH_SPARE_SLOTS 8
+#endif
+
+/**
+ * Epoch based memory reclamation.
+ *
+ * The PMEpoch class delays the destruction of the objects removed
+ * from the shared data structures until no thread can access them.
+ * A reading thread announces that it accesses the shared data by
+ * the <i>enter</i> method and stores the current epoch number into
+ * its own slot, so the readers don't write to the memory shared with
+ * each other. A removed object is retired with the current epoch and
+ * is destroyed after the epoch was advanced twice: the epoch is
+ * advanced only when all reading threads have seen the current one.
+ *
+ * The retired objects are destroyed by the threads retiring
+ * other objects, destroying a PMSnapshotPtr object or calling
+ * the <i>reclaim</i> method. An object retired while the readers
+ * access the shared data stays alive until one of these happens
+ * after they have left it.
+ *
+ * Each thread having the identifier up to PM_MAX_THREADS owns
+ * a slot. The other threads claim one of the PM_EPOCH_SPARE_SLOTS
+ * spare slots by the outermost <i>enter</i> call and free it by
+ * the outermost <i>leave</i> call.
+ *
+ * You can't construct objects of this class, use its static methods.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+class PMEpoch : public PMNonCopyable
+{
+  public:
+
+    /** Destroy function. */
+    typedef void (*destroy)( void* p );
+
+    /**
+     * Starts an access to the shared data.
+     *
+     * The calls can be nested. Must be followed by
+     * the <i>leave</i> call in the same thread.
+     */
+
+    static void enter();
+
+    /** Ends an access to the shared data. */
+    static void leave();
+
+    /**
+     * Retires an object removed from the shared data.
+     *
+     * The object is destroyed by the specified function when
+     * none of the threads can access it.
+     */
+
+    static void retire( void* p, destroy fn );
+
+    /**
+     * Destroys the retired objects which can't be accessed.
+     *
+     * @return The number of the objects waiting for destruction.
+     */
+
+    static ULONG reclaim();
+
+  private:
+
+    struct QSlot {
+      PMAtomic<ULONG> m_epoch;
+      ULONG           m_nesting;
+      volatile ULONG  m_owner;
+      char            m_pad[PM_CACHE_LINE_SIZE-3*sizeof(ULONG)];
+    };
+
+    struct QRetired {
+      void*     m_p;
+      destroy   m_fn;
+      ULONG     m_epoch;
+      QRetired* m_next;
+    };
+
+    enum { QSLOTS = PM_MAX_THREADS + PM_EPOCH_SPARE_SLOTS };
+
+    // The slots are aligned at the cache line boundary by hand,
+    // so the neighbouring readers never share a cache line.
+    static char            m_slots[( QSLOTS + 1 ) * PM_CACHE_LINE_SIZE];
+    static PMAtomic<ULONG> m_epoch;
+    static QRetired*       m_retired;
+    static ULONG           m_count;
+
+    /** Returns the first of the aligned slots. */
+    static QSlot* slots();
+    /** Returns the slot of the thread, claims a spare one if requested. */
+    static QSlot* slot( TID tid, BOOL claim );
+    /** Advances the epoch if all reading threads have seen it. */
+    static BOOL advance();
+};
+
+/**
+ * Snapshot pointer to read-mostly shared object.
+ *
+ * The PMSnapshotPtr class template keeps a pointer to a dynamically
+ * allocated object read by many threads and replaced rarely. A reader
+ * takes the current snapshot of the object by a PMSnapshotPtr::reader
+ * object and can use it until the reader is destroyed, even if the
+ * snapshot is replaced meanwhile. The readers never block and never
+ * write to the memory shared with other threads.
+ *
+ * A writer never changes the published object. It creates a new
+ * object, usually a changed copy of the current one, and publishes it
+ * by the <i>update</i> method. The replaced object is deleted by
+ * the PMEpoch class when no reader can use it: by the next update
+ * or, at the latest, by the destructor of the snapshot pointer.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+template <class T> class PMSnapshotPtr : public PMNonCopyable
+{
+  public:
+
+    /**
+     * Access to the current snapshot.
+     *
+     * The reader class gives access to the snapshot current at
+     * the moment of the reader construction until it is destroyed.
+     *
+     * You can construct and destruct objects of this class.
+     */
+
+    class reader : public PMNonCopyable
+    {
+      public:
+        /** Takes the current snapshot. */
+        reader( const PMSnapshotPtr<T>& ptr ) {
+          PMEpoch::enter();
+          m_p = ptr.m_p.load( PM_ACQUIRE );
+        }
+
+        /** Releases the snapshot. */
+       ~reader() {
+          PMEpoch::leave();
+        }
+
+        /** Returns a pointer to the snapshot. */
+        const T* get() const { return m_p; }
+        /** Returns a pointer to the snapshot. */
+        const T* operator->() const { return m_p; }
+        /** Returns a reference to the snapshot. */
+        const T& operator*() const { return *m_p; }
+
+      private:
+        const T* m_p;
+    };
+
+    friend class reader;
+
+    /** Constructs the snapshot pointer to the specified object. */
+    PMSnapshotPtr( T* p = NULL ) : m_p( p ) {}
+
+    /**
+     * Destructs the snapshot pointer and deletes the current object.
+     *
+     * No thread must read the pointer at the moment. The replaced
+     * objects which can't be accessed anymore are deleted too.
+     */
+
+   ~PMSnapshotPtr() {
+      delete m_p.load( PM_RELAXED );
+      PMEpoch::reclaim();
+    }
+
+    /**
+     * Publishes a new snapshot.
+     *
+     * The replaced object is deleted when no reader can use it.
+     */
+
+    void update( T* p )
+    {
+      T* old = m_p.exchange( p );
+
+      if( old ) {
+        PMEpoch::retire( old, dispose );
+      }
+    }
+
+  private:
+    PMAtomic<T*> m_p;
+
+    /** Deletes a replaced snapshot. */
+    static void dispose( void* p ) {
+      delete (T*)p;
+    }
+};
+
+#endif
@@ -18,14 +18,27 @@
  */
 
 PMThread::PMThread()
-: m_tid       ( -1             ),
-  m_stack_size( 256 * 1024     ),
-  m_hmq       ( PMGUI::hmq()   ),
-  m_guard     ( NULLHANDLE     ),
-  m_pclass    ( PRTYC_NOCHANGE ),
-  m_pdelta    ( 0              )
+: m_tid          ( -1             ),
+  m_stack_size   ( 256 * 1024     ),
+  m_hmq          ( PMGUI::hmq()   ),
+  m_guard        ( NULLHANDLE     ),
+  m_pclass       ( PRTYC_NOCHANGE ),
+  m_pdelta       ( 0              ),
+  m_message_queue( TRUE           )
 {}
 
+/* The GUI objects created by the deferred initialization.
+ */
+
+static PMGUI* deferred_guis[ PM_MAX_THREADS ];
+
+/* Initializes the GUI facilities of the current thread on demand.
+ */
+
+void PMThread::deferred_gui() {
+  deferred_guis[ PMGUI::tid()] = new PMGUI();
+}
+
 /* Thread launching routine.
  */
 
@@ -34,7 +47,11 @@ void PMThread::launch( PMThread* runit )
   PMGUI* gui = NULL;
 
   if( PMGUI::ptype() == PT_PM ) {
-    gui = new PMGUI();
+    if( runit->m_message_queue ) {
+      gui = new PMGUI();
+    } else {
+      PMGUI::defer( deferred_gui );
+    }
   }
 
   DosCreateMutexSem( NULL, &runit->m_guard, 0, TRUE );
@@ -47,6 +64,13 @@ void PMThread::launch( PMThread* runit )
   runit->m_tid   = -1;
 
   WinPostQueueMsg( runit->m_hmq, PM_THREAD_END, MPFROMP( runit ), 0 );
+
+  if( !gui ) {
+    PMGUI::defer( NULL );
+    gui = deferred_guis[ PMGUI::tid()];
+    deferred_guis[ PMGUI::tid()] = NULL;
+  }
+
   delete gui;
 }
 
@@ -159,6 +159,25 @@ class PMThread : public PMNonCopyable {
 
     void stack_size( unsigned long size );
 
+    /**
+     * Returns TRUE if the thread creates its message queue at start.
+     */
+
+    BOOL message_queue() const;
+
+    /**
+     * Sets whether the thread creates its message queue at start.
+     *
+     * By default each thread of a Presentation Manager application
+     * initializes the GUI facilities and creates its message queue
+     * at start. A thread that does not create windows can skip this.
+     * In that case the GUI facilities are initialized by the first
+     * call of <i>PMGUI::hab</i> from the thread, if it is ever made.
+     * It only takes affect the next time the thread is started.
+     */
+
+    void message_queue( BOOL create );
+
   protected:
 
     /**
@@ -180,8 +199,10 @@ class PMThread : public PMNonCopyable {
     unsigned long m_stack_size;
     ULONG    m_pclass;
     LONG     m_pdelta;
+    BOOL     m_message_queue;
 
     static void launch( PMThread* );
+    static void deferred_gui();
 };
 
 /* Returns this thread's stack size
@@ -198,6 +219,20 @@ inline void PMThread::stack_size( unsigned long size ) {
   m_stack_size = size;
 }
 
+/* Returns TRUE if the thread creates its message queue at start
+ */
+
+inline BOOL PMThread::message_queue() const {
+  return m_message_queue;
+}
+
+/* Sets whether the thread creates its message queue at start
+ */
+
+inline void PMThread::message_queue( BOOL create ) {
+  m_message_queue = create;
+}
+
 /* Obtains the identifier of the thread
  */
 
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#include <string.h>
+
+#include "pm_threadpool.h"
+#include "pm_memory.h"
+#include "pm_lock.h"
+#include "pm_smp.h"
+
+/* Creates a pool and starts its worker threads.
+ */
+
+PMThreadPool::PMThreadPool( ULONG threads )
+
+: m_count     ( threads ),
+  m_next      ( 0       ),
+  m_pending   ( 0       ),
+  m_unfinished( 0       ),
+  m_sleeping  ( 0       ),
+  m_stop      ( FALSE   )
+{
+  ULONG i;
+
+  if( !m_count ) {
+    m_count = PMGUI::processors();
+  }
+
+  memset( m_slots, 0, sizeof( m_slots ));
+
+  m_deques  = new QDeque[ m_count ];
+  m_workers = new QWorker*[ m_count ];
+
+  for( i = 0; i < m_count; i++ ) {
+    m_deques[i].m_tasks  = (QTask*)xmalloc( PM_THREADPOOL_DEQUE_SIZE * sizeof( QTask ));
+    m_deques[i].m_mask   = PM_THREADPOOL_DEQUE_SIZE - 1;
+    m_deques[i].m_head   = 0;
+    m_deques[i].m_tail   = 0;
+    m_deques[i].m_asleep = FALSE;
+  }
+  for( i = 0; i < m_count; i++ ) {
+    m_workers[i] = new QWorker( this, i );
+    m_workers[i]->start();
+  }
+}
+
+/* Destroys the pool.
+ */
+
+PMThreadPool::~PMThreadPool()
+{
+  ULONG i;
+
+  xchg((ULONG&)m_stop, (ULONG)TRUE );
+
+  for( i = 0; i < m_count; i++ ) {
+    m_deques[i].m_wakeup.post();
+  }
+  for( i = 0; i < m_count; i++ ) {
+    m_workers[i]->join();
+    delete m_workers[i];
+  }
+  for( i = 0; i < m_count; i++ ) {
+    xfree( m_deques[i].m_tasks );
+  }
+
+  delete[] m_workers;
+  delete[] m_deques;
+}
+
+/* Returns the index of the current worker thread or
+ * the number of the worker threads.
+ */
+
+ULONG PMThreadPool::current() const
+{
+  TID tid = PMGUI::tid();
+
+  // Each worker thread stores its index plus one into the slot
+  // of its identifier. The worker threads having the identifiers
+  // above PM_MAX_THREADS are treated as the other threads.
+  if( tid < PM_MAX_THREADS && m_slots[tid] ) {
+    return m_slots[tid] - 1;
+  } else {
+    return m_count;
+  }
+}
+
+/* Wakes one sleeping worker thread, preferring the specified one.
+ */
+
+void PMThreadPool::wake( ULONG index )
+{
+  ULONG i;
+
+  for( i = 0; i < m_count; i++ )
+  {
+    QDeque* deque = &m_deques[( index + i ) % m_count ];
+
+    if( deque->m_asleep && cmpxchg((ULONG&)deque->m_asleep, (ULONG)FALSE, (ULONG)TRUE ) == TRUE ) {
+      deque->m_wakeup.post();
+      break;
+    }
+  }
+}
+
+/* Adds a task to the specified queue.
+ */
+
+void PMThreadPool::push( ULONG index, const QTask& task )
+{
+  QDeque* deque = &m_deques[index];
+  PMLock<PMFastMutex> lock( deque->m_mutex );
+
+  if( deque->m_tail - deque->m_head > deque->m_mask ) {
+    // The queue is full and must be doubled.
+    ULONG  size  = deque->m_mask + 1;
+    QTask* tasks = (QTask*)xmalloc( 2 * size * sizeof( QTask ));
+    ULONG  i;
+
+    for( i = 0; i < size; i++ ) {
+      tasks[i] = deque->m_tasks[( deque->m_head + i ) & deque->m_mask ];
+    }
+
+    xfree( deque->m_tasks );
+    deque->m_tasks = tasks;
+    deque->m_mask  = 2 * size - 1;
+    deque->m_head  = 0;
+    deque->m_tail  = size;
+  }
+
+  deque->m_tasks[ deque->m_tail++ & deque->m_mask ] = task;
+}
+
+/* Takes a task from the own queue or steals it from another one.
+ */
+
+BOOL PMThreadPool::take( ULONG index, QTask* task )
+{
+  ULONG i;
+
+  // The own queue is used as a stack, it keeps the caches warm.
+  {
+    QDeque* deque = &m_deques[index];
+    PMLock<PMFastMutex> lock( deque->m_mutex );
+
+    if( deque->m_head != deque->m_tail ) {
+      *task = deque->m_tasks[ --deque->m_tail & deque->m_mask ];
+      xadd((ULONG&)m_pending, (ULONG)-1 );
+      return TRUE;
+    }
+  }
+
+  // The oldest tasks of other queues are stolen.
+  for( i = 1; i < m_count; i++ )
+  {
+    QDeque* deque = &m_deques[( index + i ) % m_count ];
+
+    if( deque->m_head != deque->m_tail ) {
+      PMLock<PMFastMutex> lock( deque->m_mutex );
+
+      if( deque->m_head != deque->m_tail ) {
+        *task = deque->m_tasks[ deque->m_head++ & deque->m_mask ];
+        xadd((ULONG&)m_pending, (ULONG)-1 );
+        return TRUE;
+      }
+    }
+  }
+
+  return FALSE;
+}
+
+/* Submits a task.
+ */
+
+void PMThreadPool::submit( task fn, void* arg, task done )
+{
+  QTask task;
+  ULONG index = current();
+
+  task.m_fn   = fn;
+  task.m_done = done;
+  task.m_arg  = arg;
+  task.m_hwnd = done ? PMGUI::task_window() : NULLHANDLE;
+
+  if( index == m_count ) {
+    index = xadd((ULONG&)m_next, 1UL ) % m_count;
+  }
+
+  xadd((ULONG&)m_unfinished, 1UL );
+  push( index, task );
+  xadd((ULONG&)m_pending, 1UL );
+
+  if( m_sleeping ) {
+    wake( index );
+  }
+}
+
+/* Executes a task.
+ */
+
+void PMThreadPool::execute( const QTask& task )
+{
+  task.m_fn( task.m_arg );
+
+  if( task.m_done ) {
+    if( !task.m_hwnd || !WinPostMsg( task.m_hwnd, PM_TASK_END,
+                                     MPFROMP( task.m_done ), MPFROMP( task.m_arg )))
+    {
+      task.m_done( task.m_arg );
+    }
+  }
+
+  if( xadd((ULONG&)m_unfinished, (ULONG)-1 ) == 1 ) {
+    m_idle.post();
+  }
+}
+
+/* Worker thread function.
+ */
+
+void PMThreadPool::run( ULONG index )
+{
+  QDeque* deque = &m_deques[index];
+  TID     tid   = PMGUI::tid();
+  QTask   task;
+
+  if( tid < PM_MAX_THREADS ) {
+    m_slots[tid] = index + 1;
+  }
+
+  for(;;)
+  {
+    if( take( index, &task )) {
+      execute( task );
+      continue;
+    }
+
+    // The notify is reset before the thread is marked as sleeping and
+    // the counters are checked, therefore the post issued by a submitting
+    // thread after that can't be lost.
+    deque->m_wakeup.reset();
+    xchg((ULONG&)deque->m_asleep, (ULONG)TRUE );
+    xadd((ULONG&)m_sleeping, 1UL );
+
+    if( !m_pending && !m_stop ) {
+      deque->m_wakeup.wait();
+    }
+
+    xchg((ULONG&)deque->m_asleep, (ULONG)FALSE );
+    xadd((ULONG&)m_sleeping, (ULONG)-1 );
+
+    if( m_stop && !m_pending ) {
+      break;
+    }
+  }
+
+  if( tid < PM_MAX_THREADS ) {
+    m_slots[tid] = 0;
+  }
+}
+
+/* Waits until all submitted tasks are executed.
+ */
+
+void PMThreadPool::wait()
+{
+  for(;;) {
+    m_idle.reset();
+    if( !m_unfinished ) {
+      break;
+    }
+    m_idle.wait();
+  }
+}
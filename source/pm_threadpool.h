@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_THREADPOOL_H
+#define PM_THREADPOOL_H
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_thread.h"
+#include "pm_fastmutex.h"
+#include "pm_notify.h"
+#include "pm_gui.h"
+
+#ifndef PM_THREADPOOL_DEQUE_SIZE
+
+/**
+ * Sets the initial capacity of the task queue of each
+ * worker thread. The queues grow on demand. Must be a power of two.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+#define PM_THREADPOOL_DEQUE_SIZE 64
+#endif
+
+/**
+ * Thread pool class.
+ *
+ * The PMThreadPool class runs small tasks, each of them is a function
+ * and its argument, on a fixed set of the worker threads started once.
+ * By default the pool has one worker thread per processor.
+ *
+ * Each worker thread has its own task queue. The tasks submitted
+ * by a worker thread are put into its own queue and are executed
+ * by it in the last in first out order, while the tasks submitted
+ * by other threads are distributed among the queues in turn. A worker
+ * thread having an empty queue steals the oldest task from
+ * the queue of another worker thread.
+ *
+ * A task can have a completion function. It is called by the thread
+ * that submitted the task when this thread dispatches the PM_TASK_END
+ * message posted to its object window (see <i>PMGUI::task_window</i>)
+ * after the task is executed. Any message loop of the thread dispatches
+ * the message, including the loops of the modal dialogs. If the
+ * submitting thread has no message queue, the completion function
+ * is called by the worker thread.
+ *
+ * The worker threads don't create message queues at start.
+ * A submitted task wakes at most one sleeping worker thread.
+ *
+ * The task functions must not throw exceptions.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+class PMThreadPool : public PMNonCopyable
+{
+  public:
+
+    /** Task function. */
+    typedef void (*task)( void* arg );
+
+    /**
+     * Creates a pool and starts its worker threads.
+     *
+     * @param threads  The number of the worker threads. If it is zero,
+     *                 one worker thread per processor is started.
+     */
+
+    PMThreadPool( ULONG threads = 0 );
+
+    /**
+     * Destroys the pool.
+     *
+     * Waits until all submitted tasks are executed
+     * and stops the worker threads.
+     */
+
+   ~PMThreadPool();
+
+    /** Returns the number of the worker threads. */
+    ULONG threads() const { return m_count; }
+
+    /**
+     * Submits a task.
+     *
+     * @param fn    The task function.
+     * @param arg   The argument passed to the task function.
+     * @param done  The completion function or NULL. It is
+     *              called with the same argument.
+     */
+
+    void submit( task fn, void* arg, task done = NULL );
+
+    /** Waits until all submitted tasks are executed. */
+    void wait();
+
+  private:
+
+    struct QTask {
+      task   m_fn;
+      task   m_done;
+      void*  m_arg;
+      HWND   m_hwnd;
+    };
+
+    struct QDeque {
+      PMFastMutex    m_mutex;
+      QTask*         m_tasks;
+      ULONG          m_mask;
+      ULONG          m_head;
+      ULONG          m_tail;
+      volatile ULONG m_asleep;
+      PMNotify       m_wakeup;
+    };
+
+    class QWorker : public PMThread {
+      public:
+        QWorker( PMThreadPool* pool, ULONG index ) : m_pool( pool ), m_index( index ) {
+          message_queue( FALSE );
+        }
+      protected:
+        virtual void operator()() { m_pool->run( m_index ); }
+      private:
+        PMThreadPool* m_pool;
+        ULONG         m_index;
+    };
+
+    friend class QWorker;
+
+    ULONG          m_count;
+    QWorker**      m_workers;
+    QDeque*        m_deques;
+    volatile ULONG m_next;
+    volatile ULONG m_pending;
+    volatile ULONG m_unfinished;
+    volatile ULONG m_sleeping;
+    volatile ULONG m_stop;
+    PMNotify       m_idle;
+    ULONG          m_slots[PM_MAX_THREADS];
+
+    /** Returns the index of the current worker thread or the number of the worker threads. */
+    ULONG current() const;
+    /** Wakes one sleeping worker thread, preferring the specified one. */
+    void wake( ULONG index );
+    /** Adds a task to the specified queue. */
+    void push( ULONG index, const QTask& task );
+    /** Takes a task from the own queue or steals it from another one. */
+    BOOL take( ULONG index, QTask* task );
+    /** Executes a task. */
+    void execute( const QTask& task );
+    /** Worker thread function. */
+    void run( ULONG index );
+};
+
+#endif
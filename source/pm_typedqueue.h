@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_TYPEDQUEUE_H
+#define PM_TYPEDQUEUE_H
+
+#include "pm_queue.h"
+#include <new.h>
+
+/**
+ * Typed queue class.
+ *
+ * The PMTypedQueue class template is a PMQueue which passes values
+ * of the type T instead of the untyped data pointers. The values are
+ * copied into the storage placed just after the queue element in the
+ * same slab of the element pool and are destroyed in this storage
+ * when they are read, so passing a small value costs no memory
+ * allocation at all in the steady state.
+ *
+ * The copy constructor and the assignment operator of the type T
+ * must not throw exceptions.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+template <class T> class PMTypedQueue : protected PMQueue
+{
+  public:
+
+    /** Creates a queue object. */
+    PMTypedQueue() : PMQueue( sizeof( T ), destroy ) {}
+
+    using PMQueue::clear;
+    using PMQueue::empty;
+    using PMQueue::cancel;
+    using PMQueue::close;
+    using PMQueue::closed;
+    using PMQueue::aging;
+    using PMQueue::collect_stats;
+    using PMQueue::latency_stats;
+    using PMQueue::reset_stats;
+    using PMQueue::pool_limit;
+    using PMQueue::pool_hits;
+    using PMQueue::pool_misses;
+
+    /**
+     * Adds a value to a queue.
+     *
+     * @param value     The value to be added.
+     * @param priority  Priority of the value.
+     */
+
+    void write( const T& value, ULONG priority = 0 ) {
+      write_payload( 0, &value, copy, priority );
+    }
+
+    /**
+     * Reads a value from a queue.
+     *
+     * If the queue is empty, the read method blocks the calling
+     * thread until a value is written by another thread.
+     *
+     * @param value     The variable that receives the value.
+     * @param priority  The address of the variable that receives
+     *                  the priority of the value or NULL.
+     *
+     * @return TRUE, if the value is read. FALSE, if the
+     *         waiting is canceled or the queue is closed.
+     */
+
+    BOOL read( T& value, ULONG* priority = NULL ) {
+      return read_payload( 0, 0xFFFFFFFFUL, &value, assign,
+                           priority, SEM_INDEFINITE_WAIT ) == PM_QUEUE_OK;
+    }
+
+    /**
+     * Reads a value from a queue with wait timeout.
+     *
+     * @param value     The variable that receives the value.
+     * @param priority  The address of the variable that receives
+     *                  the priority of the value or NULL.
+     * @param msec      This is the maximum amount of time the
+     *                  user wants to allow the thread to be blocked.
+     *
+     * @return PM_QUEUE_OK, PM_QUEUE_TIMEOUT, PM_QUEUE_CANCELED
+     *         or PM_QUEUE_CLOSED.
+     */
+
+    ULONG read( T& value, ULONG* priority, ULONG msec ) {
+      return read_payload( 0, 0xFFFFFFFFUL, &value, assign, priority, msec );
+    }
+
+  private:
+
+    /** Constructs the payload from the value. */
+    static void copy( void* target, const void* source ) {
+      new( target ) T( *(const T*)source );
+    }
+
+    /** Assigns the payload to the value. */
+    static void assign( void* target, const void* source ) {
+      *(T*)target = *(const T*)source;
+    }
+
+    /** Destroys the payload. */
+    static void destroy( void* payload ) {
+      ((T*)payload)->~T();
+    }
+};
+
+#endif
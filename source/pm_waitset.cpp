@@ -0,0 +1,433 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#include <string.h>
+#include <types.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <nerrno.h>
+
+#include "pm_waitset.h"
+#include "pm_memory.h"
+#include "pm_lock.h"
+#include "pm_error.h"
+
+#define  RETRY_TIME 50
+
+/* Constructs the wait set.
+ */
+
+PMWaitSet::PMWaitSet()
+
+: m_sources ( NULL       ),
+  m_count   ( 0          ),
+  m_size    ( 0          ),
+  m_next    ( 0          ),
+  m_sockets ( 0          ),
+  m_hmux    ( NULLHANDLE ),
+  m_watcher ( NULL       ),
+  m_stop    ( FALSE      ),
+  m_signaled( FALSE      )
+{
+  SEMRECORD record;
+  APIRET    rc;
+
+  m_wakeup[0] = -1;
+  m_wakeup[1] = -1;
+
+  // The notify posted by the socket watching thread is always
+  // waited for, so the muxwait semaphore is never empty.
+  record.hsemCur = (HSEM)m_received.handle();
+  record.ulUser  = 0;
+
+  if(( rc = DosCreateMuxWaitSem( NULL, &m_hmux, 1, &record, DCMW_WAIT_ANY )) != NO_ERROR ) {
+    PM_THROW_DOSERROR( rc );
+  }
+}
+
+/* Destructs the wait set.
+ */
+
+PMWaitSet::~PMWaitSet()
+{
+  ULONG i;
+
+  if( m_watcher ) {
+    m_mutex.request();
+    m_stop = TRUE;
+    rearm();
+    m_mutex.release();
+    m_watcher->join();
+    delete m_watcher;
+  }
+
+  if( m_wakeup[0] != -1 ) {
+    soclose( m_wakeup[0] );
+    soclose( m_wakeup[1] );
+  }
+
+  for( i = 0; i < m_count; i++ ) {
+    if( m_sources[i].m_type == QQUEUE ) {
+      m_sources[i].m_queue->unwatch( m_sources[i].m_notify );
+      delete m_sources[i].m_notify;
+    }
+  }
+
+  xfree( m_sources );
+  DosCloseMuxWaitSem( m_hmux );
+}
+
+/* Adds a source to the list.
+ */
+
+void PMWaitSet::append( ULONG type, ULONG id, PMNotify* notify, PMQueue* queue, int socket )
+{
+  PMLock<PMFastMutex> lock( m_mutex );
+  QSource* source;
+
+  if( m_count == m_size ) {
+    m_size    = m_size ? m_size * 2 : 8;
+    m_sources = (QSource*)xrealloc( m_sources, m_size * sizeof( QSource ));
+  }
+
+  source = &m_sources[ m_count++ ];
+
+  source->m_type   = type;
+  source->m_id     = id;
+  source->m_notify = notify;
+  source->m_queue  = queue;
+  source->m_socket = socket;
+  source->m_armed  = type == QSOCKET;
+  source->m_ready  = FALSE;
+}
+
+/* Adds a notify to the muxwait semaphore.
+ */
+
+APIRET PMWaitSet::attach( PMNotify* notify, ULONG id )
+{
+  SEMRECORD record;
+
+  record.hsemCur = (HSEM)notify->handle();
+  record.ulUser  = id;
+
+  return DosAddMuxWaitSem( m_hmux, &record );
+}
+
+/* Registers a notify.
+ */
+
+void PMWaitSet::add( PMNotify& notify, ULONG id )
+{
+  APIRET rc;
+
+  if(( rc = attach( &notify, id )) != NO_ERROR ) {
+    PM_THROW_DOSERROR( rc );
+  }
+
+  append( QNOTIFY, id, &notify, NULL, -1 );
+}
+
+/* Registers a queue.
+ */
+
+void PMWaitSet::add( PMQueue& queue, ULONG id )
+{
+  PMNotify* notify = new PMNotify;
+  APIRET    rc;
+
+  if(( rc = attach( notify, id )) != NO_ERROR ) {
+    delete notify;
+    PM_THROW_DOSERROR( rc );
+  }
+
+  queue.watch( notify );
+  append( QQUEUE, id, notify, &queue, -1 );
+}
+
+/* Registers a connected socket.
+ */
+
+void PMWaitSet::add( PMSocket& socket, ULONG id )
+{
+  if( !m_watcher )
+  {
+    if( socketpair( AF_UNIX, SOCK_STREAM, 0, m_wakeup ) != 0 ) {
+      PM_THROW_ERROR( sock_errno(), "TCP/IP", PMSocket::strerror( sock_errno()));
+    }
+
+    m_watcher = new QWatcher( this );
+    m_watcher->start();
+  }
+
+  append( QSOCKET, id, NULL, NULL, socket.handle());
+  ++m_sockets;
+
+  PMLock<PMFastMutex> lock( m_mutex );
+  rearm();
+}
+
+/* Unregisters a source.
+ */
+
+BOOL PMWaitSet::remove( ULONG id )
+{
+  QSource source;
+  ULONG   i;
+
+  for( i = 0; i < m_count; i++ ) {
+    if( m_sources[i].m_id == id ) {
+      break;
+    }
+  }
+
+  if( i == m_count ) {
+    return FALSE;
+  }
+
+  source = m_sources[i];
+
+  m_mutex.request();
+  memmove( m_sources + i, m_sources + i + 1, ( m_count - i - 1 ) * sizeof( QSource ));
+  if( --m_count <= m_next ) {
+    m_next = 0;
+  }
+  // The watching thread must stop selecting the removed socket.
+  if( source.m_type == QSOCKET ) {
+    rearm();
+  }
+  m_mutex.release();
+
+  if( source.m_type == QSOCKET ) {
+    --m_sockets;
+  } else {
+    DosDeleteMuxWaitSem( m_hmux, (HSEM)source.m_notify->handle());
+  }
+
+  if( source.m_type == QQUEUE ) {
+    source.m_queue->unwatch( source.m_notify );
+    delete source.m_notify;
+  }
+
+  return TRUE;
+}
+
+/* Wakes up the socket watching thread. The mutex must be held.
+ */
+
+void PMWaitSet::rearm()
+{
+  char byte = 0;
+
+  // One byte at a time is enough, the thread collects
+  // the sockets again after it has received it.
+  if( m_watcher && !m_signaled ) {
+    m_signaled = TRUE;
+    send( m_wakeup[1], &byte, 1, 0 );
+  }
+}
+
+/* Looks for a ready source starting after the last reported one.
+ */
+
+BOOL PMWaitSet::poll( ULONG* id, ULONG* msec )
+{
+  ULONG i;
+
+  if( m_sockets )
+  {
+    PMLock<PMFastMutex> lock( m_mutex );
+    BOOL  watch = FALSE;
+
+    // The notify is reset before the sockets are examined, therefore
+    // the post issued by the watching thread after that can't be lost.
+    m_received.reset();
+
+    // The sockets reported before are consumed by now and are watched
+    // again. If data is left in them, they are reported once more.
+    for( i = 0; i < m_count; i++ ) {
+      if( m_sources[i].m_type == QSOCKET && !m_sources[i].m_armed && !m_sources[i].m_ready ) {
+        m_sources[i].m_armed = TRUE;
+        watch = TRUE;
+      }
+    }
+
+    if( watch ) {
+      rearm();
+    }
+  }
+
+  for( i = 0; i < m_count; i++ )
+  {
+    QSource* source = &m_sources[( m_next + i ) % m_count ];
+    BOOL     ready  = FALSE;
+    ULONG    count;
+    ULONG    due;
+
+    switch( source->m_type ) {
+      case QNOTIFY:
+        ready = DosQueryEventSem( source->m_notify->handle(), &count ) == NO_ERROR && count;
+        break;
+
+      case QQUEUE:
+        // The notify is reset before the queue is examined, therefore
+        // the post issued by a writer after that can't be lost.
+        source->m_notify->reset();
+        if(( ready = source->m_queue->ready( &due )) == FALSE && due < *msec ) {
+          *msec = due;
+        }
+        break;
+
+      case QSOCKET:
+        m_mutex.request();
+        if(( ready = source->m_ready ) == TRUE ) {
+          source->m_ready = FALSE;
+        }
+        m_mutex.release();
+        break;
+    }
+
+    if( ready ) {
+      *id = source->m_id;
+      m_next = ( m_next + i + 1 ) % m_count;
+      return TRUE;
+    }
+  }
+
+  return FALSE;
+}
+
+/* Waits until any source is ready.
+ */
+
+BOOL PMWaitSet::wait( ULONG* id ) {
+  return wait( id, SEM_INDEFINITE_WAIT );
+}
+
+/* Waits until any source is ready with timeout.
+ */
+
+BOOL PMWaitSet::wait( ULONG* id, ULONG msec )
+{
+  ULONG start = 0;
+  ULONG current;
+  ULONG timeout;
+  ULONG user;
+
+  if( msec != SEM_INDEFINITE_WAIT ) {
+    DosQuerySysInfo( QSV_MS_COUNT, QSV_MS_COUNT, &start, sizeof( start ));
+  }
+
+  for(;;)
+  {
+    timeout = SEM_INDEFINITE_WAIT;
+
+    if( poll( id, &timeout )) {
+      return TRUE;
+    }
+
+    if( msec != SEM_INDEFINITE_WAIT ) {
+      DosQuerySysInfo( QSV_MS_COUNT, QSV_MS_COUNT, &current, sizeof( current ));
+
+      if( current - start >= msec ) {
+        return FALSE;
+      }
+      if( msec - ( current - start ) < timeout ) {
+        timeout = msec - ( current - start );
+      }
+    }
+
+    // Wakes up when any source can become ready, the ready one
+    // is looked for by the next poll.
+    WinWaitMuxWaitSem( m_hmux, timeout, &user );
+  }
+}
+
+/* Socket watching thread function.
+ */
+
+void PMWaitSet::watch_sockets()
+{
+  BOOL  failed = FALSE;
+  ULONG errors = 0;
+
+  for(;;)
+  {
+    fd_set readlist;
+    BOOL   received = FALSE;
+    int    max;
+    ULONG  i;
+
+    m_mutex.request();
+
+    if( m_stop ) {
+      m_mutex.release();
+      break;
+    }
+
+    FD_ZERO( &readlist );
+    FD_SET( m_wakeup[0], &readlist );
+    max = m_wakeup[0];
+
+    // After a failed select only the wakeup socket is
+    // selected until the set of the sockets is changed.
+    for( i = 0; i < m_count && !failed; i++ ) {
+      if( m_sources[i].m_type == QSOCKET && m_sources[i].m_armed ) {
+        FD_SET( m_sources[i].m_socket, &readlist );
+        if( m_sources[i].m_socket > max ) {
+          max = m_sources[i].m_socket;
+        }
+      }
+    }
+
+    m_mutex.release();
+
+    if( select( max + 1, &readlist, NULL, NULL, NULL ) < 0 )
+    {
+      int error = sock_errno();
+
+      if(( error == SOCENOTSOCK || error == SOCEBADF ) && !failed ) {
+        // A socket is probably closed before it was removed from the set.
+        failed = TRUE;
+      } else if( errors++ ) {
+        // The error repeats or even the wakeup socket can't be selected,
+        // the thread waits a while instead of looping. A transient error,
+        // such as an interrupted call, is retried at once.
+        DosSleep( RETRY_TIME );
+        failed = FALSE;
+      }
+      continue;
+    }
+
+    errors = 0;
+
+    m_mutex.request();
+
+    if( FD_ISSET( m_wakeup[0], &readlist )) {
+      char byte;
+      recv( m_wakeup[0], &byte, 1, 0 );
+      m_signaled = FALSE;
+      failed = FALSE;
+    }
+
+    // The ready sockets are not selected again until the owner
+    // of the wait set has reported them.
+    for( i = 0; i < m_count; i++ ) {
+      if( m_sources[i].m_type == QSOCKET && m_sources[i].m_armed &&
+          FD_ISSET( m_sources[i].m_socket, &readlist ))
+      {
+        m_sources[i].m_armed = FALSE;
+        m_sources[i].m_ready = TRUE;
+        received = TRUE;
+      }
+    }
+
+    m_mutex.release();
+
+    if( received ) {
+      m_received.post();
+    }
+  }
+}
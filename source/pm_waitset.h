@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2016 Dmitry A.Steklenev
+ */
+
+#ifndef PM_WAITSET_H
+#define PM_WAITSET_H
+
+#include "pm_os2.h"
+#include "pm_noncopyable.h"
+#include "pm_notify.h"
+#include "pm_fastmutex.h"
+#include "pm_thread.h"
+#include "pm_queue.h"
+#include "pm_socket.h"
+
+/**
+ * Waits for any of several sources.
+ *
+ * The PMWaitSet class blocks a thread until any of the registered
+ * notifies, queues or sockets becomes ready and reports the identifier
+ * of the ready source. This lets one thread serve several sources without
+ * polling each of them in turn.
+ *
+ * A notify is ready while it is posted, a queue is ready while
+ * a reading method would not block and a socket is ready while data
+ * can be received from it. A ready source is reported by every
+ * <i>wait</i> call until it is consumed; the sources are examined
+ * in turn, so a busy source doesn't starve the others.
+ *
+ * The notifies and the queues are waited for by one muxwait
+ * semaphore. The sockets are selected by a thread started when the
+ * first socket is registered; it posts the wait set when any of them
+ * receives data. The thread is blocked in select until then and is
+ * woken up through a local socket pair when the set of the watched
+ * sockets changes. A reported socket is watched again by the next
+ * <i>wait</i> call, so the data left in it is reported once more
+ * after the thread has selected it.
+ *
+ * The registered objects must live longer than the wait set or
+ * must be removed from it. The wait set must be used by one thread.
+ *
+ * You can construct and destruct objects of this class.
+ *
+ * @author  Dmitry A.Steklenev
+ * @version 1.0
+ */
+
+class PMWaitSet : public PMNonCopyable
+{
+  public:
+    /** Constructs the wait set. */
+    PMWaitSet();
+    /** Destructs the wait set. */
+   ~PMWaitSet();
+
+    /**
+     * Registers a notify.
+     *
+     * @param notify  The notify. It is never reset by the wait set.
+     * @param id      The identifier reported when the notify is posted.
+     *
+     * @exception PMError If the notify can't be waited for.
+     */
+
+    void add( PMNotify& notify, ULONG id );
+
+    /**
+     * Registers a queue.
+     *
+     * @param queue   The queue.
+     * @param id      The identifier reported when the queue is ready to be read.
+     *
+     * @exception PMError If the queue can't be waited for.
+     */
+
+    void add( PMQueue& queue, ULONG id );
+
+    /**
+     * Registers a connected socket.
+     *
+     * @param socket  The socket.
+     * @param id      The identifier reported when data can be received.
+     */
+
+    void add( PMSocket& socket, ULONG id );
+
+    /**
+     * Unregisters a source.
+     *
+     * @return FALSE, if there is no source having the specified identifier.
+     */
+
+    BOOL remove( ULONG id );
+
+    /**
+     * Waits until any source is ready.
+     *
+     * Blocks the calling thread indefinitely.
+     *
+     * @param  id     The identifier of the ready source.
+     * @return TRUE, if a source is ready.
+     */
+
+    BOOL wait( ULONG* id );
+
+    /**
+     * Waits until any source is ready with timeout.
+     *
+     * @param  id     The identifier of the ready source.
+     * @param  msec   This is the maximum amount of time the
+     *                user wants to allow the thread to be blocked.
+     *
+     * @return TRUE, if a source is ready.
+     */
+
+    BOOL wait( ULONG* id, ULONG msec );
+
+  private:
+
+    enum { QNOTIFY, QQUEUE, QSOCKET };
+
+    struct QSource {
+      ULONG     m_type;
+      ULONG     m_id;
+      PMNotify* m_notify;
+      PMQueue*  m_queue;
+      int       m_socket;
+      BOOL      m_armed;
+      BOOL      m_ready;
+    };
+
+    class QWatcher : public PMThread {
+      public:
+        QWatcher( PMWaitSet* set ) : m_set( set ) {
+          message_queue( FALSE );
+        }
+      protected:
+        virtual void operator()() { m_set->watch_sockets(); }
+      private:
+        PMWaitSet* m_set;
+    };
+
+    friend class QWatcher;
+
+    QSource*      m_sources;
+    ULONG         m_count;
+    ULONG         m_size;
+    ULONG         m_next;
+    ULONG         m_sockets;
+    HMUX          m_hmux;
+    QWatcher*     m_watcher;
+    volatile BOOL m_stop;
+    PMNotify      m_received;
+    int           m_wakeup[2];
+    BOOL          m_signaled;
+    PMFastMutex   m_mutex;
+
+    /** Adds a source to the list. */
+    void append( ULONG type, ULONG id, PMNotify* notify, PMQueue* queue, int socket );
+    /** Adds a notify to the muxwait semaphore. */
+    APIRET attach( PMNotify* notify, ULONG id );
+    /** Looks for a ready source starting after the last reported one. */
+    BOOL poll( ULONG* id, ULONG* msec );
+    /** Wakes up the socket watching thread. The mutex must be held. */
+    void rearm();
+    /** Socket watching thread function. */
+    void watch_sockets();
+};
+
+#endif
@@ -5,9 +5,13 @@
 #include "pm_windowset.h"
 #include "pm_debuglog.h"
 #include "pm_window.h"
+#include "pm_memory.h"
+#include "pm_lock.h"
 
-HMTX             PMWindowSet::m_mutex;
-PMWindowSet::map PMWindowSet::m_map[PM_MAX_WINDOWS];
+PMRWMutex*        PMWindowSet::m_mutex;
+PMWindowSet::map* PMWindowSet::m_map   = NULL;
+ULONG             PMWindowSet::m_size  = 0;
+ULONG             PMWindowSet::m_count = 0;
 
 /* Sets a window user pointer value to a new window object.
  */
@@ -17,10 +21,10 @@ PMWindow* PMWindowSet::setptr( HWND hwnd, class PMWindow* new_window )
   PMWindow* old_window = NULL;
   BOOL rc;
 
-  DosRequestMutexSem( m_mutex, SEM_INDEFINITE_WAIT );
+  m_mutex->request();
   old_window = (PMWindow*)WinQueryWindowPtr( hwnd, QWP_USER );
   rc = WinSetWindowPtr( hwnd, QWP_USER, new_window );
-  DosReleaseMutexSem( m_mutex );
+  m_mutex->release();
 
   if( !rc ) {
     PM_THROW_GUIERROR();
@@ -29,39 +33,102 @@ PMWindow* PMWindowSet::setptr( HWND hwnd, class PMWindow* new_window )
   return old_window;
 }
 
-/* Inserts a new window object to the windows set.
+/* Returns the home slot of the specified window handle.
  */
 
-PMWindow* PMWindowSet::insert( HWND hwnd, PMWindow* new_window )
+ULONG PMWindowSet::hash( HWND hwnd )
 {
-  PMWindow* old_window = NULL;
-  int i, pos;
+  ULONG h = (ULONG)hwnd;
 
-  DosRequestMutexSem( m_mutex, SEM_INDEFINITE_WAIT );
+  // The window handles differ mostly in the low bits,
+  // so they are mixed before masking.
+  h = (( h >> 16 ) ^ h ) * 0x45D9F3BUL;
+  h = (( h >> 16 ) ^ h ) * 0x45D9F3BUL;
+  h = (( h >> 16 ) ^ h );
 
-  for( i = 0, pos = -1; i < sizeof( m_map ) / sizeof( m_map[0] ); i++ ) {
-    if( m_map[i].handle == hwnd ) {
-      pos = i;
-      break;
+  return h & ( m_size - 1 );
+}
+
+/* Doubles the number of slots in the hash table.
+ *
+ * Must be called with the exclusive access to the windows set.
+ */
+
+void PMWindowSet::grow()
+{
+  map*  old_map  = m_map;
+  ULONG old_size = m_size;
+  ULONG i, pos;
+
+  m_map  = (map*)xcalloc( old_size ? old_size * 2 : PM_WINDOWSET_SIZE, sizeof( map ));
+  m_size = old_size ? old_size * 2 : PM_WINDOWSET_SIZE;
+
+  for( i = 0; i < old_size; i++ ) {
+    if( old_map[i].handle != NULLHANDLE ) {
+      for( pos = hash( old_map[i].handle ); m_map[pos].handle != NULLHANDLE; pos = ( pos + 1 ) & ( m_size - 1 ))
+      {}
+      m_map[pos] = old_map[i];
     }
-    if( m_map[i].handle == NULLHANDLE && pos < 0 ) {
-      pos = i;
+  }
+
+  xfree( old_map );
+}
+
+/* Finds the slot of the specified window handle.
+ *
+ * Returns TRUE if the handle is found. Otherwise the position
+ * receives the unused slot where the handle can be placed.
+ */
+
+BOOL PMWindowSet::find( HWND hwnd, ULONG* pos )
+{
+  ULONG i;
+
+  if( !m_size ) {
+    return FALSE;
+  }
+
+  for( i = hash( hwnd ); m_map[i].handle != NULLHANDLE; i = ( i + 1 ) & ( m_size - 1 )) {
+    if( m_map[i].handle == hwnd ) {
+      *pos = i;
+      return TRUE;
     }
   }
 
-  if( pos >= 0 ) {
-    DEBUGLOG2(( "PMWindowSet: insert pointer %08X handle %08X\n", new_window, hwnd ));
-    old_window = m_map[pos].window;
-    m_map[pos].handle = hwnd;
-    m_map[pos].window = new_window;
+  *pos = i;
+  return FALSE;
+}
+
+/* Inserts a new window object to the windows set.
+ */
+
+PMWindow* PMWindowSet::insert( HWND hwnd, PMWindow* new_window )
+{
+  PMLock<PMRWMutex> lock( *m_mutex );
+  PMWindow* old_window;
+  ULONG pos;
+
+  // The NULLHANDLE marks the unused slots and can't be stored.
+  if( hwnd == NULLHANDLE ) {
+    return NULL;
   }
 
-  DosReleaseMutexSem( m_mutex );
+  if( !find( hwnd, &pos )) {
+    // The load factor is kept below 3/4.
+    if(( m_count + 1 ) * 4 > m_size * 3 ) {
+      grow();
+      find( hwnd, &pos );
+    }
 
-  if( pos < 0 ) {
-    PM_THROW_ERROR( PM_ERR_TOO_MANY_WINDOWS, "PMLIB", "Too many strangers." );
+    m_map[pos].handle = hwnd;
+    m_map[pos].window = NULL;
+    ++m_count;
   }
 
+  DEBUGLOG2(( "PMWindowSet: insert pointer %08X handle %08X\n", new_window, hwnd ));
+
+  old_window = m_map[pos].window;
+  m_map[pos].window = new_window;
   return old_window;
 }
 
@@ -70,40 +137,46 @@ PMWindow* PMWindowSet::insert( HWND hwnd, PMWindow* new_window )
 
 void PMWindowSet::remove( HWND hwnd )
 {
-  int i;
+  PMLock<PMRWMutex> lock( *m_mutex );
+  ULONG pos, next, home;
 
-  DosRequestMutexSem( m_mutex, SEM_INDEFINITE_WAIT );
+  if( hwnd == NULLHANDLE || !find( hwnd, &pos )) {
+    return;
+  }
 
-  for( i = 0; i < sizeof( m_map ) / sizeof( m_map[0] ); i++ ) {
-    if( m_map[i].handle == hwnd ) {
-        DEBUGLOG2(( "PMWindowSet: remove pointer %08X handle %08X\n", m_map[i].window, m_map[i].handle ));
-        m_map[i].handle =  NULLHANDLE;
-        m_map[i].window =  NULL;
-        break;
+  DEBUGLOG2(( "PMWindowSet: remove pointer %08X handle %08X\n", m_map[pos].window, m_map[pos].handle ));
+
+  // The following elements of the cluster are shifted back to keep
+  // all of them reachable from their home slots without tombstones.
+  for( next = ( pos + 1 ) & ( m_size - 1 ); m_map[next].handle != NULLHANDLE; next = ( next + 1 ) & ( m_size - 1 ))
+  {
+    home = hash( m_map[next].handle );
+
+    if((( next - home ) & ( m_size - 1 )) >= (( next - pos ) & ( m_size - 1 ))) {
+      m_map[pos] = m_map[next];
+      pos = next;
     }
   }
 
-  DosReleaseMutexSem( m_mutex );
+  m_map[pos].handle = NULLHANDLE;
+  m_map[pos].window = NULL;
+  --m_count;
 }
 
 /* Queries a window object.
+ *
+ * The windows set is changed rarely but is queried for each
+ * message, so the queries share the access to it.
  */
 
 PMWindow* PMWindowSet::query( HWND hwnd )
 {
-  PMWindow* window = NULL;
-  int i;
+  PMSharedLock<PMRWMutex> lock( *m_mutex );
+  ULONG pos;
 
-  DosRequestMutexSem( m_mutex, SEM_INDEFINITE_WAIT );
-
-  for( i = 0; i < sizeof( m_map ) / sizeof( m_map[0] ); i++ ) {
-    if( m_map[i].handle == hwnd ) {
-      window = m_map[i].window;
-      break;
-    }
+  if( hwnd != NULLHANDLE && find( hwnd, &pos )) {
+    return m_map[pos].window;
+  } else {
+    return NULL;
   }
-
-  DosReleaseMutexSem( m_mutex );
-  return window;
 }
-
@@ -7,19 +7,20 @@
 
 #include "pm_os2.h"
 #include "pm_initwindowset.h"
+#include "pm_rwmutex.h"
 
-#ifndef PM_MAX_WINDOWS
+#ifndef PM_WINDOWSET_SIZE
 
 /**
- * Sets the maximum number of the wrapped windows (that is
- * not created inside this library) supported by the
- * library.
+ * Sets the initial number of slots in the hash table of the
+ * wrapped windows (that is not created inside this library).
+ * The table grows on demand. Must be a power of two.
  *
  * @author  Dmitry A.Steklenev
  * @version 1.0
  */
 
-#define PM_MAX_WINDOWS 150
+#define PM_WINDOWSET_SIZE 256
 #endif
 
 #ifndef __ccdoc__
@@ -58,8 +59,17 @@ class PMWindowSet : public PMNonCopyable
       class PMWindow* window;
     };
 
-    static HMTX m_mutex;
-    static map  m_map[PM_MAX_WINDOWS];
+    static PMRWMutex* m_mutex;
+    static map*       m_map;
+    static ULONG      m_size;
+    static ULONG      m_count;
+
+    /** Returns the home slot of the specified window handle. */
+    static ULONG hash( HWND hwnd );
+    /** Finds the slot of the specified window handle. */
+    static BOOL find( HWND hwnd, ULONG* pos );
+    /** Doubles the number of slots in the hash table. */
+    static void grow();
 };
 
 #endif